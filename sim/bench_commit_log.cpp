@@ -0,0 +1,107 @@
+#include "commit_log.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+/*
+ * Throughput of the commit log comparator, in GB/s of log read.
+ *
+ *   ./bench_commit_log [<MB per log>]
+ *
+ * Writes a retire.out and a spike log of the same pcs, a loop nest with
+ * calls, to /tmp and compares them; the files are in the page cache, so
+ * this measures the parsing.  The same comparison with getline and a
+ * stringstream split per line, as checker.py did, is the baseline.
+ */
+
+static std::vector<unsigned> make_pcs(size_t n) {
+  std::mt19937 rng(450);
+  std::vector<unsigned> pcs;
+  pcs.reserve(n);
+  unsigned pc = 0x1000;
+  while (pcs.size() < n) {
+    pcs.push_back(pc);
+    unsigned r = rng() % 16;
+    if (r == 0) pc = 0x1000 + 4 * (rng() % 4096);     // call / return
+    else if (r < 3) pc -= 4 * (rng() % 8);            // loop back edge
+    else pc += 4;
+  }
+  return pcs;
+}
+
+static std::string temp_file(const char *name) {
+  char path[64];
+  std::snprintf(path, sizeof path, "/tmp/%s.XXXXXX", name);
+  int fd = mkstemp(path);
+  if (fd < 0) {
+    std::perror("mkstemp");
+    std::exit(1);
+  }
+  close(fd);
+  return path;
+}
+
+// the lines as $fwrite and spike -l print them
+static void write_logs(const std::vector<unsigned> &pcs, const std::string &retire, const std::string &spike) {
+  FILE *r = std::fopen(retire.c_str(), "w"), *s = std::fopen(spike.c_str(), "w");
+  for (size_t i = 0; i < pcs.size(); ++i) {
+    std::fprintf(r, "[%11zu] %08x\n", 3 + 2 * (i / 4), pcs[i]);
+    std::fprintf(s, "core   0: 0x%016x (0x00b50533) add     a0, a0, a1\n", pcs[i]);
+  }
+  std::fclose(r);
+  std::fclose(s);
+}
+
+// checker.py in C++
+static unsigned long long naive_compare(const std::string &spike, const std::string &retire,
+                                        unsigned long long &bytes) {
+  std::ifstream sf(spike), rf(retire);
+  std::string sl, rl, tok;
+  unsigned long long mismatches = 0;
+  bytes = 0;
+  while (std::getline(sf, sl) && std::getline(rf, rl)) {
+    bytes += sl.size() + rl.size() + 2;
+    std::vector<std::string> st, rt;
+    for (std::istringstream is(sl); is >> tok;) st.push_back(tok);
+    for (std::istringstream is(rl); is >> tok;) rt.push_back(tok);
+    std::string spc = st[2].substr(st[2].find('x') + 1), rpc = rt[2];
+    if (std::stoull(spc, nullptr, 16) != std::stoull(rpc, nullptr, 16)) mismatches++;
+  }
+  return mismatches;
+}
+
+int main(int argc, char **argv) {
+  double mb = argc > 1 ? std::atof(argv[1]) : 256;
+  // a spike line is 61 bytes, the longer of the two
+  size_t n = (size_t) (mb * 1e6 / 61);
+  std::string retire = temp_file("retire.out"), spike = temp_file("spike.out");
+  write_logs(make_pcs(n), retire, spike);
+
+  commit_compare_options_t opts;
+  for (int round = 0; round < 3; ++round) {
+    commit_log_reader_t a(spike), b(retire);
+    auto start = std::chrono::steady_clock::now();
+    commit_compare_result_t res = commit_log_compare(a, b, opts, stdout);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::printf("commitcmp: %llu entries, %llu mismatches, %.1f MB in %.3f s: %.2f GB/s\n",
+                res.compared, res.mismatches, res.bytes / 1e6, seconds, res.bytes / seconds / 1e9);
+  }
+
+  unsigned long long bytes;
+  auto start = std::chrono::steady_clock::now();
+  unsigned long long mismatches = naive_compare(spike, retire, bytes);
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  std::printf("getline + split: %llu mismatches, %.1f MB in %.3f s: %.2f GB/s\n",
+              mismatches, bytes / 1e6, seconds, bytes / seconds / 1e9);
+
+  unlink(retire.c_str());
+  unlink(spike.c_str());
+  return 0;
+}
@@ -0,0 +1,110 @@
+#include "sim_memory.h"
+
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+/*
+ * Micro-benchmark of the memory backends on a fetch-heavy trace.
+ *
+ * The trace mimics what sim_main2 issues every half cycle: a 16-byte
+ * IMem fetch of the current line, and every few fetches an 8-byte DMem
+ * access into the data/stack region.  Besides the time per access, the
+ * number of times a backend has to search its storage (hash lookups for
+ * BucketMemory, page table walks for PagedMemory) per simulated cycle is
+ * reported.
+ *
+ * The backends are compared with every fetch going to the memory.  A
+ * second run fetches as sim_main2 does, where IMem skips a line that is
+ * still in place, and reports the skipped fetches on their own.
+ */
+
+struct trace_entry_t {
+  unsigned addr;
+  bool fetch;
+};
+
+static std::vector<trace_entry_t> make_fetch_trace(unsigned n) {
+  std::mt19937 rng(450);
+  std::vector<trace_entry_t> trace;
+  trace.reserve(n);
+
+  unsigned pc = 0x80000000;
+  unsigned block_left = 0;
+  while (trace.size() < n) {
+    if (!block_left) {
+      // jump to another basic block in a 64KiB text segment
+      pc = 0x80000000 + (rng() % 0x10000 & ~0xfu);
+      block_left = 4 + rng() % 28;
+    }
+    // both clock edges fetch the same line
+    trace.push_back({pc, true});
+    trace.push_back({pc, true});
+    pc += 16;
+    --block_left;
+
+    if (rng() % 4 == 0) {
+      unsigned data = rng() % 2 ? 0x10000000 + (rng() % 0x4000 & ~0x7u)
+                                : 0x1fffc000 + (rng() % 0x4000 & ~0x7u);
+      trace.push_back({data, false});
+    }
+  }
+  return trace;
+}
+
+static void bench(const std::string &kind, const std::vector<trace_entry_t> &trace, unsigned rounds, bool elide) {
+  auto mem = make_IdeaMemory(kind);
+  IMem imem(mem.get());
+  imem.set_elision(elide);
+  DMem dmem(mem.get());
+
+  // give the text and data region some content
+  std::vector<char> text(0x10000);
+  for (unsigned i = 0; i < text.size(); ++i) text[i] = (char) (i * 7 + 3);
+  mem->write_bytes(text.data(), text.size(), 0x80000000);
+  mem->write_bytes(text.data(), 0x4000, 0x10000000);
+
+  // separate ports, as on the core: IMem keeps the last line in <line>
+  char line[16], data[8];
+  unsigned long long sum = 0;
+  unsigned long long lookups_st = mem->lookup_count();
+  auto st = std::chrono::steady_clock::now();
+  for (unsigned r = 0; r < rounds; ++r) {
+    for (auto &a : trace) {
+      if (a.fetch) {
+        imem.read_transction(a.addr, line);
+        sum += (unsigned char) line[0];
+      } else {
+        dmem.read_transction(a.addr, data);
+        sum += (unsigned char) data[0];
+      }
+    }
+  }
+  auto ed = std::chrono::steady_clock::now();
+
+  double ns = std::chrono::duration<double, std::nano>(ed - st).count();
+  unsigned long long accesses = (unsigned long long) trace.size() * rounds;
+  unsigned long long cycles = 0;
+  for (auto &a : trace) cycles += a.fetch;
+  cycles = cycles / 2 * rounds;
+  double lookups = mem->lookup_count() - lookups_st;
+  printf("%-8s %12llu accesses  %8.2f ns/access  %6.3f lookups/cycle",
+         kind.c_str(), accesses, ns / accesses, lookups / cycles);
+  if (elide)
+    printf("  %llu fetches skipped", imem.elided_fetch_count());
+  printf("  (checksum %llu)\n", sum);
+}
+
+int main(int argc, char **argv) {
+  unsigned rounds = argc > 1 ? std::stoul(argv[1]) : 20;
+  auto trace = make_fetch_trace(1 << 20);
+
+  printf("fetch-heavy trace: %zu accesses x %u rounds\n", trace.size(), rounds);
+  printf("every fetch from the memory:\n");
+  for (auto kind : {"bucket", "flat", "paged"}) bench(kind, trace, rounds, false);
+  printf("a line still in place is not fetched again:\n");
+  for (auto kind : {"bucket", "flat", "paged"}) bench(kind, trace, rounds, true);
+  return 0;
+}
@@ -0,0 +1,169 @@
+#include "store_buffer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <list>
+#include <random>
+#include <string>
+#include <vector>
+
+/*
+ * Micro-benchmark of the StoreBuffer on a store-heavy trace.
+ *
+ * The trace follows insertionSort (spike-software/progs) compiled without
+ * optimization: every step of the inner loop loads a[j], stores it to
+ * a[j + 1] and spills j to the stack.  Stores retire in bursts of up to
+ * COMMIT_WIDTH, and the exit of the inner loop is mispredicted, which
+ * flushes the pending stores.  The ring buffer is compared with the list
+ * of heap allocated requests it replaced.
+ */
+
+enum class sb_op_t : unsigned char { store, load, commit, flush };
+
+struct sb_event_t {
+  sb_op_t op;
+  unsigned addr;
+  unsigned char size;  // log2 of the size, or the # of commits
+};
+
+static std::vector<sb_event_t> make_sort_trace(unsigned n) {
+  std::mt19937 rng(450);
+  std::vector<sb_event_t> trace;
+  trace.reserve(n);
+
+  const unsigned array = 0x10000000, stack = 0x1ffffff0;
+  unsigned pending = 0, target = 8;
+  auto retire = [&](bool all) {
+    while (pending && (all || pending > target)) {
+      unsigned c = std::min(pending, 1 + (unsigned) (rng() % 6));
+      trace.push_back({sb_op_t::commit, 0, (unsigned char) c});
+      pending -= c;
+    }
+    target = 4 + rng() % 24;
+  };
+  auto store = [&](unsigned addr, unsigned char size) {
+    trace.push_back({sb_op_t::store, addr, size});
+    if (++pending == StoreBuffer::kCapacity) retire(true);
+  };
+
+  for (unsigned i = 1; trace.size() < n; i = i % 1000 + 1) {
+    trace.push_back({sb_op_t::load, array + 4 * i, 2});   // key = a[i]
+    store(stack - 20, 2);                                   // spill key
+    unsigned j = i - 1, steps = rng() % 16;
+    for (unsigned s = 0; s < steps && j < 1000; ++s, --j) {
+      trace.push_back({sb_op_t::load, stack - 24, 2});     // reload j
+      trace.push_back({sb_op_t::load, array + 4 * j, 2});  // a[j]
+      store(array + 4 * (j + 1), 2);                        // a[j + 1] = a[j]
+      store(stack - 24, 2);                                 // j--
+      if (rng() % 2) retire(false);
+    }
+    retire(false);
+    // the loop exit is mispredicted, the wrong path stores are flushed
+    if (rng() % 3 == 0) {
+      store(array + 4 * j, 2);
+      store(stack - 24, 2);
+      trace.push_back({sb_op_t::flush, 0, 0});
+      pending = 0;
+    }
+    store(array + 4 * (j + 1), 2);                          // a[j + 1] = key
+    retire(true);
+  }
+  return trace;
+}
+
+// the std::list based buffer StoreBuffer replaced, without the logging
+class ListStoreBuffer {
+  public:
+    ListStoreBuffer(std::unique_ptr<DMem> dm) : dmem(std::move(dm)) { }
+
+    ~ListStoreBuffer() { FlushStoreBuffer(); }
+
+    void SetLogging(bool) { }
+
+    void AddStoreRequest(store_request_t *req) { buffer.push_back(req); }
+
+    void CommitStoreRequest(unsigned num_commit) {
+      for (unsigned i = 0; i < num_commit; ++i) {
+        store_request_t *req = buffer.front();
+        dmem->write_transcation(req->addr, reinterpret_cast<char *>(&req->data), data_size_map[req->size]);
+        delete req;
+        buffer.pop_front();
+      }
+    }
+
+    void FlushStoreBuffer() {
+      while (!buffer.empty()) {
+        delete buffer.front();
+        buffer.pop_front();
+      }
+    }
+
+    void LoadData(unsigned load_addr, char *dest) {
+      dmem->read_transction(load_addr, dest);
+      for (auto req : buffer) {
+        int offset = req->addr - load_addr;
+        int size = data_size_map[req->size];
+        const char *data_ptr = reinterpret_cast<const char *>(&req->data);
+        if (offset >= 0 && offset <= 7) memcpy(dest + offset, data_ptr, std::min(size, 8 - offset));
+        else if (offset < 0 && offset > -size) memcpy(dest, data_ptr - offset, size + offset);
+      }
+    }
+
+  private:
+    std::unique_ptr<DMem> dmem;
+    std::list<store_request_t *> buffer;
+};
+
+template <typename Buffer, typename Add>
+static void bench(const char *name, const std::vector<sb_event_t> &trace, unsigned rounds, Add &&add) {
+  auto mem = make_PagedMemory();
+  Buffer buffer(std::make_unique<DMem>(mem.get()));
+  buffer.SetLogging(false);
+
+  unsigned long long sum = 0, value = 0;
+  char dest[8];
+  auto st = std::chrono::steady_clock::now();
+  for (unsigned r = 0; r < rounds; ++r) {
+    for (auto &e : trace) {
+      switch (e.op) {
+        case sb_op_t::store:  add(buffer, e.addr, ++value, e.size); break;
+        case sb_op_t::commit: buffer.CommitStoreRequest(e.size); break;
+        case sb_op_t::flush:  buffer.FlushStoreBuffer(); break;
+        case sb_op_t::load: {
+          buffer.LoadData(e.addr, dest);
+          unsigned long long v;
+          memcpy(&v, dest, sizeof v);
+          sum += v;
+          break;
+        }
+      }
+    }
+  }
+  auto ed = std::chrono::steady_clock::now();
+
+  double ns = std::chrono::duration<double, std::nano>(ed - st).count();
+  unsigned long long ops = (unsigned long long) trace.size() * rounds;
+  printf("%-8s %12llu ops  %8.2f ns/op  (checksum %llu)\n", name, ops, ns / ops, sum);
+}
+
+int main(int argc, char **argv) {
+  unsigned rounds = argc > 1 ? std::stoul(argv[1]) : 20;
+  auto trace = make_sort_trace(1 << 20);
+
+  unsigned stores = 0, loads = 0;
+  for (auto &e : trace) {
+    stores += e.op == sb_op_t::store;
+    loads += e.op == sb_op_t::load;
+  }
+  printf("insertionSort trace: %zu ops (%u stores, %u loads) x %u rounds\n", trace.size(), stores, loads, rounds);
+
+  bench<ListStoreBuffer>("list", trace, rounds, [](ListStoreBuffer &b, unsigned addr, unsigned long long data, unsigned char size) {
+    b.AddStoreRequest(new store_request_t(addr, data, size));
+  });
+  bench<StoreBuffer>("ring", trace, rounds, [](StoreBuffer &b, unsigned addr, unsigned long long data, unsigned char size) {
+    b.AddStoreRequest(addr, data, size);
+  });
+  return 0;
+}
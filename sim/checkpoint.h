@@ -0,0 +1,43 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+/*
+ * Helpers for the host side of a simulation checkpoint.
+ *
+ * Values are stored in host byte order, a checkpoint is only meant to be
+ * restored by the same simulator binary.
+ */
+
+template <typename T>
+void ckpt_write(std::ostream &os, const T &val) {
+  static_assert(std::is_trivially_copyable<T>::value, "only plain values can be saved");
+  os.write(reinterpret_cast<const char *>(&val), sizeof val);
+}
+
+inline void ckpt_write(std::ostream &os, const std::string &str) {
+  ckpt_write<unsigned long long>(os, str.size());
+  os.write(str.data(), str.size());
+}
+
+template <typename T>
+void ckpt_read(std::istream &is, T &val) {
+  static_assert(std::is_trivially_copyable<T>::value, "only plain values can be restored");
+  if (!is.read(reinterpret_cast<char *>(&val), sizeof val))
+    throw std::runtime_error("checkpoint: unexpected end of data");
+}
+
+inline void ckpt_read(std::istream &is, std::string &str) {
+  unsigned long long size;
+  ckpt_read(is, size);
+  str.resize(size);
+  if (!is.read(&str[0], size))
+    throw std::runtime_error("checkpoint: unexpected end of data");
+}
+
+#endif /* CHECKPOINT_H */
@@ -0,0 +1,304 @@
+#include "commit_log.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const struct hex_table_t {
+  unsigned char value[256];
+  hex_table_t() {
+    std::memset(value, 0xff, sizeof value);
+    for (int i = 0; i < 10; i++) value['0' + i] = i;
+    for (int i = 0; i < 6; i++) value['a' + i] = value['A' + i] = 10 + i;
+  }
+} hex_table;
+
+bool parse_hex(const char *&p, const char *end, uint64_t &value) {
+  const char *st = p;
+  uint64_t v = 0;
+  for (unsigned d; p < end && (d = hex_table.value[(unsigned char) *p]) < 16; ++p)
+    v = v << 4 | d;
+  value = v;
+  return p != st;
+}
+
+static const char *skip_blanks(const char *p, const char *end) {
+  while (p < end && (*p == ' ' || *p == '\t')) ++p;
+  return p;
+}
+
+bool parse_commit_line(const char *p, const char *end, uint64_t &pc) {
+  p = skip_blanks(p, end);
+  if (p == end) return false;
+
+  // retire.out: "[<cycle>] <pc>", the cycle is padded by $fwrite
+  if (*p == '[') {
+    p = static_cast<const char *>(std::memchr(p, ']', end - p));
+    if (!p) return false;
+    p = skip_blanks(p + 1, end);
+    return parse_hex(p, end, pc);
+  }
+
+  // spike: "core   0: 0x<pc> (0x<inst>) ...", with --log-commits the
+  // privilege level comes first: "core   0: 3 0x<pc> ..."
+  if (end - p > 4 && std::memcmp(p, "core", 4) == 0) {
+    p = static_cast<const char *>(std::memchr(p + 4, ':', end - p - 4));
+    if (!p) return false;
+    p = skip_blanks(p + 1, end);
+    if (end - p > 2 && *p >= '0' && *p <= '3' && p[1] == ' ')
+      p = skip_blanks(p + 1, end);
+    if (end - p < 3 || p[0] != '0' || p[1] != 'x') return false;
+    p += 2;
+    return parse_hex(p, end, pc);
+  }
+  return false;
+}
+
+commit_log_reader_t::commit_log_reader_t(const std::string &file) {
+  if (file == "-") {
+    fd = 0;
+  } else {
+    fd = open(file.c_str(), O_RDONLY);
+    owns_fd = fd >= 0;
+  }
+  if (fd < 0) return;
+
+  struct stat st;
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+    void *p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p != MAP_FAILED) {
+      madvise(p, st.st_size, MADV_SEQUENTIAL);
+      mapping = static_cast<char *>(p);
+      map_size = st.st_size;
+      data = mapping;
+      len = bytes = map_size;
+      eof = true;
+      return;
+    }
+  }
+  buf.resize(kChunk);
+  data = buf.data();
+}
+
+commit_log_reader_t::~commit_log_reader_t() {
+  if (mapping) munmap(mapping, map_size);
+  if (owns_fd) close(fd);
+}
+
+bool commit_log_reader_t::refill() {
+  // keep the partial line at the end of the chunk
+  if (pos) {
+    std::memmove(buf.data(), buf.data() + pos, len - pos);
+    len -= pos;
+    pos = 0;
+  }
+  if (len == buf.size()) buf.resize(2 * buf.size());   // a line longer than a chunk
+  data = buf.data();
+  ssize_t n;
+  do {
+    n = read(fd, buf.data() + len, buf.size() - len);
+  } while (n < 0 && errno == EINTR);
+  if (n <= 0) {
+    eof = true;
+    return false;
+  }
+  len += n;
+  bytes += n;
+  return true;
+}
+
+bool commit_log_reader_t::next(commit_entry_t &entry) {
+  while (true) {
+    const char *st = data + pos;
+    const char *nl = static_cast<const char *>(std::memchr(st, '\n', len - pos));
+    const char *end = nl;
+    if (!nl) {
+      if (!eof && refill()) continue;
+      if (pos == len) return false;
+      end = data + len;   // the last line has no newline
+    }
+    pos = end - data + (nl != nullptr);
+    ++line;
+    if (parse_commit_line(st, end, entry.pc)) {
+      entry.line = line;
+      return true;
+    }
+    ++skipped;
+  }
+}
+
+namespace {
+
+// one of the logs: the entries read ahead for a resync, and the last
+// <context> ones taken, for a report
+struct side_t {
+  commit_log_reader_t &log;
+  const commit_compare_options_t &opts;
+  std::deque<commit_entry_t> ahead;
+  std::vector<commit_entry_t> past;   // a ring, by taken % context
+  unsigned long long taken = 0;
+  unsigned long long dropped = 0;     // by skip()
+  bool at_end = false;
+
+  side_t(commit_log_reader_t &log, const commit_compare_options_t &opts)
+    : log(log), opts(opts), past(opts.context) { }
+
+  bool ignored(uint64_t pc) const {
+    for (auto &range : opts.ignore_pcs) {
+      if (pc >= range.first && pc < range.second) return true;
+    }
+    return false;
+  }
+
+  // the next entry of the log that is not ignored
+  bool read(commit_entry_t &e) {
+    while (!at_end) {
+      if (!log.next(e)) at_end = true;
+      else if (!ignored(e.pc)) return true;
+    }
+    return false;
+  }
+
+  // the i-th entry from the current one, nullptr after the end
+  const commit_entry_t *peek(size_t i) {
+    commit_entry_t e;
+    while (ahead.size() <= i && read(e)) ahead.push_back(e);
+    return i < ahead.size() ? &ahead[i] : nullptr;
+  }
+
+  void take(const commit_entry_t &e) {
+    if (!past.empty()) past[taken % past.size()] = e;
+    ++taken;
+  }
+
+  void pop() {
+    take(ahead.front());
+    ahead.pop_front();
+  }
+
+  size_t num_past() const { return taken < past.size() ? taken : past.size(); }
+
+  // the i-th of the last entries taken, oldest first
+  const commit_entry_t &last(size_t i) const { return past[(taken - num_past() + i) % past.size()]; }
+
+  void skip(unsigned long long n) {
+    for (; n && peek(0); --n) {
+      ahead.pop_front();
+      ++dropped;
+    }
+  }
+
+  unsigned long long drain() {
+    unsigned long long n = ahead.size();
+    ahead.clear();
+    for (commit_entry_t e; read(e); ++n) { }
+    return n;
+  }
+};
+
+}
+
+static void print_pair(FILE *out, const char *mark, const commit_entry_t *a, const commit_entry_t *b) {
+  fprintf(out, "  %s ", mark);
+  if (a) fprintf(out, "a:%-10llu 0x%08llx", a->line, (unsigned long long) a->pc);
+  else fprintf(out, "%-23s", "");
+  if (b) fprintf(out, "   b:%-10llu 0x%08llx", b->line, (unsigned long long) b->pc);
+  fprintf(out, "\n");
+}
+
+static void report(FILE *out, unsigned long long n, unsigned long long index, side_t &a, side_t &b) {
+  fprintf(out, "mismatch %llu at entry %llu:\n", n, index);
+  size_t na = a.num_past(), nb = b.num_past(), rows = std::max(na, nb);
+  for (size_t r = 0; r < rows; r++) {
+    print_pair(out, " ", r + na >= rows ? &a.last(r + na - rows) : nullptr,
+               r + nb >= rows ? &b.last(r + nb - rows) : nullptr);
+  }
+  print_pair(out, ">", a.peek(0), b.peek(0));
+}
+
+// the smallest skip (i, j), i + j > 0, after which two entries in a row
+// agree, or one entry at the end of a log
+static bool find_resync(side_t &a, side_t &b, unsigned window, size_t &skip_a, size_t &skip_b) {
+  for (unsigned s = 1; s + 1 < 2 * window; s++) {
+    for (unsigned i = s < window ? 0 : s - window + 1; i <= s && i < window; i++) {
+      unsigned j = s - i;
+      const commit_entry_t *ea = a.peek(i), *eb = b.peek(j);
+      if (!ea || !eb || ea->pc != eb->pc) continue;
+      const commit_entry_t *na = a.peek(i + 1), *nb = b.peek(j + 1);
+      if (na && nb && na->pc != nb->pc) continue;
+      skip_a = i;
+      skip_b = j;
+      return true;
+    }
+  }
+  return false;
+}
+
+commit_compare_result_t commit_log_compare(commit_log_reader_t &log_a, commit_log_reader_t &log_b,
+                                           const commit_compare_options_t &opts, FILE *out) {
+  commit_compare_result_t res;
+  side_t a(log_a, opts), b(log_b, opts);
+  a.skip(opts.skip_a);
+  b.skip(opts.skip_b);
+
+  while (true) {
+    // the common case, nothing read ahead and the logs agree
+    commit_entry_t fa, fb;
+    while (a.ahead.empty() && b.ahead.empty() && a.read(fa)) {
+      if (!b.read(fb)) {
+        a.ahead.push_back(fa);
+        break;
+      }
+      if (fa.pc != fb.pc) {
+        a.ahead.push_back(fa);
+        b.ahead.push_back(fb);
+        break;
+      }
+      res.compared++;
+      a.take(fa);
+      b.take(fb);
+    }
+
+    const commit_entry_t *ea = a.peek(0), *eb = b.peek(0);
+    if (!ea || !eb) break;
+    res.compared++;
+    if (ea->pc == eb->pc) {
+      a.pop();
+      b.pop();
+      continue;
+    }
+
+    res.mismatches++;
+    report(out, res.mismatches, res.compared - 1, a, b);
+    if (opts.max_mismatches && res.mismatches >= opts.max_mismatches) {
+      res.stopped_early = true;
+      break;
+    }
+
+    size_t skip_a, skip_b;
+    if (opts.resync && find_resync(a, b, opts.resync, skip_a, skip_b)) {
+      fprintf(out, "  resynced, skipped %zu entries of a and %zu of b\n", skip_a, skip_b);
+      res.resyncs++;
+      for (; skip_a; --skip_a) a.pop();
+      for (; skip_b; --skip_b) b.pop();
+    } else {
+      if (opts.resync) fprintf(out, "  no resync within %u entries\n", opts.resync);
+      a.pop();
+      b.pop();
+    }
+  }
+
+  res.entries_a = a.dropped + a.taken;
+  res.entries_b = b.dropped + b.taken;
+  if (!res.stopped_early) {
+    res.entries_a += a.drain();
+    res.entries_b += b.drain();
+  }
+  res.bytes = log_a.bytes_read() + log_b.bytes_read();
+  return res;
+}
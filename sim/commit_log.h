@@ -0,0 +1,94 @@
+#ifndef COMMIT_LOG_H
+#define COMMIT_LOG_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+
+/*
+ * Commit logs: one retired instruction per line, as written by the core
+ * (retire.out, "[<cycle>] <pc>" with the pc in hex) or by spike -l
+ * ("core   0: 0x<pc> (0x<inst>) ...").  The format is recognized per line,
+ * the lines that hold no instruction (spike's exceptions, blank lines) are
+ * skipped.
+ *
+ * A regular file is mapped and read front to back, anything else (a pipe)
+ * is read in chunks of kChunk bytes; either way the log is never copied
+ * as a whole, so traces of any length take the same memory.
+ */
+
+struct commit_entry_t {
+  uint64_t pc;
+  unsigned long long line;   // 1-based
+};
+
+// parse the hex digits at <p>, up to <end>; set <p> after the last digit.
+// Return false when there is none.
+bool parse_hex(const char *&p, const char *end, uint64_t &value);
+
+// the pc of one line (without the newline), false when it has none
+bool parse_commit_line(const char *p, const char *end, uint64_t &pc);
+
+class commit_log_reader_t {
+  public:
+    static constexpr size_t kChunk = 1 << 20;
+
+    // "-" reads the standard input
+    explicit commit_log_reader_t(const std::string &file);
+    ~commit_log_reader_t();
+
+    bool is_open() const { return fd >= 0; }
+
+    // the next instruction, false at the end of the log
+    bool next(commit_entry_t &entry);
+
+    // the bytes of the lines returned so far
+    unsigned long long bytes_read() const { return bytes - (len - pos); }
+    unsigned long long lines_skipped() const { return skipped; }
+
+  private:
+    int fd = -1;
+    bool owns_fd = false;
+    bool eof = false;
+    const char *data = nullptr;   // the mapping or buf.data()
+    char *mapping = nullptr;
+    size_t map_size = 0;
+    std::vector<char> buf;
+    size_t pos = 0, len = 0;
+    unsigned long long line = 0;
+    unsigned long long bytes = 0;
+    unsigned long long skipped = 0;
+
+    bool refill();
+};
+
+struct commit_compare_options_t {
+  unsigned max_mismatches = 10;   // stop after as many, 0 for no limit
+  unsigned context = 3;           // # of entries printed before a mismatch
+  // after a mismatch, look up to <resync> entries ahead in both logs for
+  // the pc they agree on next and continue from there; 0 compares the
+  // entries with the same index, as checker.py did
+  unsigned resync = 0;
+  // drop the first entries of a log, e.g. the boot code only spike runs
+  unsigned long long skip_a = 0, skip_b = 0;
+  // the entries with a pc in [first, second) are dropped from both logs,
+  // e.g. a known divergence window
+  std::vector<std::pair<uint64_t, uint64_t>> ignore_pcs;
+};
+
+struct commit_compare_result_t {
+  unsigned long long compared = 0;
+  unsigned long long mismatches = 0;
+  unsigned long long resyncs = 0;
+  unsigned long long entries_a = 0, entries_b = 0;
+  unsigned long long bytes = 0;
+  bool stopped_early = false;     // max_mismatches reached
+};
+
+// compare the pcs of two commit logs, the mismatches are printed to <out>
+commit_compare_result_t commit_log_compare(commit_log_reader_t &a, commit_log_reader_t &b,
+                                           const commit_compare_options_t &opts, FILE *out);
+
+#endif /* COMMIT_LOG_H */
@@ -0,0 +1,100 @@
+#include "commit_log.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+/*
+ * Compare the pcs of two commit logs, e.g. spike's and the core's:
+ *
+ *   ./commitcmp [options] [<a> <b>]
+ *
+ * <a> and <b> default to spike.out and retire.out in the current
+ * directory, "-" reads the standard input.  The logs are streamed, see
+ * commit_log.h.  The first mismatches are printed with the entries before
+ * them, then a summary with the throughput.
+ *
+ *   -n <n>, --max-mismatches=<n>  stop after <n> mismatches (10), 0 for all
+ *   --context=<n>                 print <n> entries before a mismatch (3)
+ *   --resync=<n>                  realign the logs after a mismatch, looking
+ *                                 up to <n> entries ahead in both
+ *   --skip-a=<n>, --skip-b=<n>    drop the first <n> entries of a log
+ *   --ignore-pc=<first>:<end>     drop the entries with a pc in [first, end)
+ *                                 from both logs, can be repeated
+ *
+ * The exit status is 0 when the logs agree (up to the end of the shorter
+ * one), 1 when they differ and 2 when a log can not be read.
+ */
+
+static void usage(const char *prog) {
+  std::fprintf(stderr, "usage: %s [-n <n>] [--context=<n>] [--resync=<n>] [--skip-a=<n>] [--skip-b=<n>]\n"
+                       "       [--ignore-pc=<first>:<end>]... [<a> <b>]\n", prog);
+}
+
+int main(int argc, char **argv) {
+  commit_compare_options_t opts;
+  std::string files[2] = {"spike.out", "retire.out"};
+  int num_files = 0;
+
+  for (int i = 1; i < argc; ++i) {
+    std::string arg{argv[i]};
+    if (arg == "-n" && i + 1 < argc) {
+      opts.max_mismatches = std::stoul(argv[++i]);
+    } else if (arg.rfind("--max-mismatches=", 0) == 0) {
+      opts.max_mismatches = std::stoul(arg.substr(std::strlen("--max-mismatches=")));
+    } else if (arg.rfind("--context=", 0) == 0) {
+      opts.context = std::stoul(arg.substr(std::strlen("--context=")));
+    } else if (arg.rfind("--resync=", 0) == 0) {
+      opts.resync = std::stoul(arg.substr(std::strlen("--resync=")));
+    } else if (arg.rfind("--skip-a=", 0) == 0) {
+      opts.skip_a = std::stoull(arg.substr(std::strlen("--skip-a=")));
+    } else if (arg.rfind("--skip-b=", 0) == 0) {
+      opts.skip_b = std::stoull(arg.substr(std::strlen("--skip-b=")));
+    } else if (arg.rfind("--ignore-pc=", 0) == 0) {
+      std::string range = arg.substr(std::strlen("--ignore-pc="));
+      size_t colon = range.find(':');
+      if (colon == std::string::npos) {
+        usage(argv[0]);
+        return 2;
+      }
+      opts.ignore_pcs.emplace_back(std::stoull(range.substr(0, colon), nullptr, 0),
+                                   std::stoull(range.substr(colon + 1), nullptr, 0));
+    } else if ((arg[0] != '-' || arg == "-") && num_files < 2) {
+      files[num_files++] = arg;
+    } else {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+  if (num_files == 1) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  commit_log_reader_t a(files[0]), b(files[1]);
+  for (int i = 0; i < 2; ++i) {
+    if (!(i ? b : a).is_open()) {
+      std::fprintf(stderr, "cannot open %s\n", files[i].c_str());
+      return 2;
+    }
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  commit_compare_result_t res = commit_log_compare(a, b, opts, stdout);
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  std::printf("compared %llu entries: %llu mismatches", res.compared, res.mismatches);
+  if (opts.resync) std::printf(", %llu resyncs", res.resyncs);
+  std::printf("\n");
+  if (res.stopped_early) {
+    std::printf("stopped after %u mismatches\n", opts.max_mismatches);
+  } else if (res.entries_a != res.entries_b) {
+    std::printf("%s has %llu more entries (%llu vs %llu)\n", res.entries_a > res.entries_b ? "a" : "b",
+                res.entries_a > res.entries_b ? res.entries_a - res.entries_b : res.entries_b - res.entries_a,
+                res.entries_a, res.entries_b);
+  }
+  std::printf("read %.1f MB in %.3f s (%.2f GB/s)\n", res.bytes / 1e6, seconds,
+              seconds > 0 ? res.bytes / seconds / 1e9 : 0.0);
+  return res.mismatches ? 1 : 0;
+}
@@ -0,0 +1,54 @@
+#include "console.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+console_t::console_t(int fd) : out_fd(fd) {
+  buf.reserve(kBufferSize);
+}
+
+console_t::~console_t() {
+  flush();
+  if (owns_fd) close(out_fd);
+}
+
+bool console_t::redirect(const std::string &file) {
+  int fd = open(file.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (fd < 0) return false;
+  flush();
+  if (owns_fd) close(out_fd);
+  out_fd = fd;
+  owns_fd = true;
+  return true;
+}
+
+bool console_t::parse_flush(const std::string &name, flush_t &policy) {
+  if (name == "newline") policy = flush_t::newline;
+  else if (name == "size") policy = flush_t::size;
+  else return false;
+  return true;
+}
+
+void console_t::write(const char *s, size_t len) {
+  buf.append(s, len);
+  if ((flush_policy == flush_t::newline && std::memchr(s, '\n', len)) || full()) flush();
+}
+
+void console_t::flush() {
+  if (buf.empty()) return;
+  // what the simulator printed before comes first
+  if (out_fd == STDOUT_FILENO) std::fflush(stdout);
+  else if (out_fd == STDERR_FILENO) std::fflush(stderr);
+  for (size_t done = 0; done < buf.size();) {
+    ssize_t n = ::write(out_fd, buf.data() + done, buf.size() - done);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) break;
+    done += n;
+  }
+  num_bytes += buf.size();
+  num_writes++;
+  buf.clear();
+}
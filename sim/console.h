@@ -0,0 +1,56 @@
+#ifndef CONSOLE_H
+#define CONSOLE_H
+
+#include <cstddef>
+#include <string>
+#include <unistd.h>
+
+/*
+ * A console of the target: the strings of sys_printstr, or the characters
+ * stored to 0xFFFFFFF8, buffered so that a chatty program does not cost a
+ * host write per character.
+ *
+ * The buffer goes out on a newline or only once it holds kBufferSize bytes
+ * (flush_t), and always when it is full, so it never grows past that;
+ * anything else that writes the same file, e.g. a sys_write of the target
+ * to fd 1 or 2, has to flush() first.  The console writes to <fd>, stdout
+ * by default, unless redirect()ed to a file.
+ */
+class console_t {
+  public:
+    enum class flush_t { newline, size };
+    static constexpr size_t kBufferSize = 64 << 10;
+
+    explicit console_t(int fd = STDOUT_FILENO);
+    ~console_t();
+
+    // write to <file> from now on, false when it can not be created
+    bool redirect(const std::string &file);
+    void set_flush(flush_t policy) { flush_policy = policy; }
+    // "newline" or "size"
+    static bool parse_flush(const std::string &name, flush_t &policy);
+
+    int fd() const { return out_fd; }
+
+    void put(char c) {
+      buf.push_back(c);
+      if ((c == '\n' && flush_policy == flush_t::newline) || full()) flush();
+    }
+
+    void write(const char *s, size_t len);
+    void flush();
+
+    unsigned long long bytes() const { return num_bytes + buf.size(); }
+    unsigned long long host_writes() const { return num_writes; }
+
+  private:
+    int out_fd;
+    bool owns_fd = false;
+    flush_t flush_policy = flush_t::newline;
+    std::string buf;
+    unsigned long long num_bytes = 0, num_writes = 0;
+
+    bool full() const { return buf.size() >= kBufferSize; }
+};
+
+#endif /* CONSOLE_H */
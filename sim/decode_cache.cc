@@ -0,0 +1,140 @@
+#include "decode_cache.h"
+
+#include <algorithm>
+
+const char *rv_class_name(rv_class_t kind) {
+  switch (kind) {
+    case rv_class_t::illegal: return "illegal";
+    case rv_class_t::lui:     return "lui";
+    case rv_class_t::auipc:   return "auipc";
+    case rv_class_t::jal:     return "jal";
+    case rv_class_t::jalr:    return "jalr";
+    case rv_class_t::branch:  return "branch";
+    case rv_class_t::load:    return "load";
+    case rv_class_t::store:   return "store";
+    case rv_class_t::op_imm:  return "op-imm";
+    case rv_class_t::op:      return "op";
+    case rv_class_t::mul_div: return "mul/div";
+    case rv_class_t::fence:   return "fence";
+    case rv_class_t::system:  return "system";
+  }
+  return "?";
+}
+
+static unsigned bits(unsigned raw, unsigned hi, unsigned lo) {
+  return raw >> lo & ((1u << (hi - lo + 1)) - 1);
+}
+
+// sign extend the low <width> bits
+static int sext(unsigned value, unsigned width) {
+  return (int) (value << (32 - width)) >> (32 - width);
+}
+
+// the fields a format does not have stay 0: the rs2 of an I-type is part
+// of its immediate, a shift amount is imm[4:0]
+decoded_inst_t rv32_decode(unsigned raw) {
+  decoded_inst_t d;
+  d.raw = raw;
+
+  int imm_i = sext(bits(raw, 31, 20), 12);
+  int imm_s = sext(bits(raw, 31, 25) << 5 | bits(raw, 11, 7), 12);
+  int imm_b = sext(bits(raw, 31, 31) << 12 | bits(raw, 7, 7) << 11 | bits(raw, 30, 25) << 5 | bits(raw, 11, 8) << 1, 13);
+  int imm_u = (int) (raw & 0xfffff000u);
+  int imm_j = sext(bits(raw, 31, 31) << 20 | bits(raw, 19, 12) << 12 | bits(raw, 20, 20) << 11 | bits(raw, 30, 21) << 1, 21);
+
+  switch (bits(raw, 6, 0)) {
+    case 0x37: d.kind = rv_class_t::lui;    d.imm = imm_u; break;
+    case 0x17: d.kind = rv_class_t::auipc;  d.imm = imm_u; break;
+    case 0x6f: d.kind = rv_class_t::jal;    d.imm = imm_j; break;
+    case 0x67: d.kind = rv_class_t::jalr;   d.imm = imm_i; break;
+    case 0x63: d.kind = rv_class_t::branch; d.imm = imm_b; break;
+    case 0x03: d.kind = rv_class_t::load;   d.imm = imm_i; break;
+    case 0x23: d.kind = rv_class_t::store;  d.imm = imm_s; break;
+    case 0x13: d.kind = rv_class_t::op_imm; d.imm = imm_i; break;
+    case 0x33: d.kind = bits(raw, 31, 25) == 1 ? rv_class_t::mul_div : rv_class_t::op; break;
+    case 0x0f: d.kind = rv_class_t::fence;  d.imm = imm_i; break;
+    case 0x73: d.kind = rv_class_t::system; d.imm = imm_i; break;
+    default:   d.kind = rv_class_t::illegal;
+  }
+
+  switch (d.kind) {
+    // R
+    case rv_class_t::op: case rv_class_t::mul_div:
+      d.funct7 = bits(raw, 31, 25);
+      d.rs2 = bits(raw, 24, 20);
+      // fall through
+    // I
+    case rv_class_t::jalr: case rv_class_t::load: case rv_class_t::op_imm:
+    case rv_class_t::fence: case rv_class_t::system:
+      d.rd = bits(raw, 11, 7);
+      d.funct3 = bits(raw, 14, 12);
+      d.rs1 = bits(raw, 19, 15);
+      break;
+    // S, B
+    case rv_class_t::store: case rv_class_t::branch:
+      d.funct3 = bits(raw, 14, 12);
+      d.rs1 = bits(raw, 19, 15);
+      d.rs2 = bits(raw, 24, 20);
+      break;
+    // U, J
+    case rv_class_t::lui: case rv_class_t::auipc: case rv_class_t::jal:
+      d.rd = bits(raw, 11, 7);
+      break;
+    case rv_class_t::illegal:
+      break;
+  }
+  return d;
+}
+
+decode_cache_t::decode_cache_t(IdeaMemory *mem)
+  : mem(mem), code_pages(kPages / 64) { }
+
+decode_cache_t::page_t *decode_cache_t::find_page(unsigned vpn) {
+  auto &page = pages[vpn];
+  if (!page) {
+    page = std::make_unique<page_t>();
+    code_pages[vpn / 64] |= 1ull << (vpn % 64);
+  }
+  last_vpn = vpn;
+  last_page = page.get();
+  return last_page;
+}
+
+void decode_cache_t::fill(page_t *page, unsigned slot, unsigned pc) {
+  ++misses;
+  unsigned raw;
+  mem->fetch_block<4>(reinterpret_cast<char *>(&raw), pc);
+  page->insts[slot] = rv32_decode(raw);
+  page->valid[slot] = true;
+}
+
+void decode_cache_t::drop(unsigned vpn, unsigned addr, unsigned size) {
+  page_t *page = pages.at(vpn).get();
+  unsigned long long first = addr, end = first + size;
+  unsigned long long page_st = (unsigned long long) vpn << kPageBits;
+  first = first < page_st ? page_st : first;
+  end = end > page_st + (1u << kPageBits) ? page_st + (1u << kPageBits) : end;
+  for (unsigned long long a = first & ~3ull; a < end; a += 4) {
+    unsigned slot = (a >> 2) % kSlots;
+    invalidations += page->valid[slot];
+    page->valid[slot] = false;
+  }
+}
+
+void decode_cache_t::clear() {
+  pages.clear();
+  std::fill(code_pages.begin(), code_pages.end(), 0);
+  last_vpn = ~0u;
+  last_page = nullptr;
+}
+
+void retire_profile_t::print(FILE *out) const {
+  fprintf(out, "retired instructions by class:\n");
+  for (unsigned k = 0; k < kClasses; ++k) {
+    if (!counts[k]) continue;
+    fprintf(out, "  %-8s %14llu  %5.1f%%\n", rv_class_name(static_cast<rv_class_t>(k)), counts[k],
+            100.0 * counts[k] / total);
+  }
+  fprintf(out, "  decode cache: %llu hits, %llu misses, %llu invalidated\n",
+          cache->hit_count(), cache->miss_count(), cache->invalidation_count());
+}
@@ -0,0 +1,128 @@
+#ifndef DECODE_CACHE_H
+#define DECODE_CACHE_H
+
+#include <array>
+#include <bitset>
+#include <cstdio>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "sim_memory.h"
+
+// the instruction classes of RV32IM, by major opcode
+enum class rv_class_t : unsigned char {
+  illegal, lui, auipc, jal, jalr, branch, load, store, op_imm, op, mul_div, fence, system
+};
+
+const char *rv_class_name(rv_class_t kind);
+
+struct decoded_inst_t {
+  unsigned raw = 0;
+  rv_class_t kind = rv_class_t::illegal;
+  // 0 when the format has no such field
+  unsigned char funct3 = 0;
+  unsigned char funct7 = 0;
+  unsigned char rd = 0, rs1 = 0, rs2 = 0;
+  int imm = 0;        // sign extended, shifted into place for U/B/J
+
+  bool writes_rd() const {
+    switch (kind) {
+      case rv_class_t::branch: case rv_class_t::store: case rv_class_t::fence:
+      case rv_class_t::illegal: return false;
+      default: return rd != 0;
+    }
+  }
+};
+
+decoded_inst_t rv32_decode(unsigned raw);
+
+/*
+ * The decoded instructions by pc, so the tools that follow the retired
+ * instructions (the golden model, tracers, profilers) decode each one once.
+ *
+ * The instructions are fetched from the memory on a miss.  Every page an
+ * instruction was decoded from is marked in a bitmap of code pages; the
+ * writes that go through DMem or sim_t (syscalls) call invalidate(), which
+ * only looks further on a code page and then drops the written words.
+ * Anything that replaces the memory wholesale (a checkpoint restore) has
+ * to call clear().
+ */
+class decode_cache_t {
+  public:
+    static constexpr unsigned kPageBits = 12;
+
+    explicit decode_cache_t(IdeaMemory *mem);
+
+    // <pc> must be 4-byte aligned
+    const decoded_inst_t &decode(unsigned pc) {
+      unsigned vpn = pc >> kPageBits;
+      page_t *page = vpn == last_vpn ? last_page : find_page(vpn);
+      unsigned slot = (pc >> 2) % kSlots;
+      if (!page->valid[slot]) fill(page, slot, pc);
+      else ++hits;
+      return page->insts[slot];
+    }
+
+    void invalidate(unsigned addr, unsigned size) {
+      unsigned long long end = (unsigned long long) addr + size;
+      for (unsigned long long vpn = addr >> kPageBits; vpn << kPageBits < end && vpn < kPages; ++vpn) {
+        if (code_pages[vpn / 64] >> (vpn % 64) & 1) drop(vpn, addr, size);
+      }
+    }
+
+    void clear();
+
+    unsigned long long hit_count() const { return hits; }
+    unsigned long long miss_count() const { return misses; }
+    unsigned long long invalidation_count() const { return invalidations; }
+
+  private:
+    static constexpr unsigned kSlots = 1u << (kPageBits - 2);
+    static constexpr unsigned kPages = 1u << (32 - kPageBits);
+
+    struct page_t {
+      std::bitset<kSlots> valid;
+      std::array<decoded_inst_t, kSlots> insts;
+    };
+
+    IdeaMemory *mem;
+    std::vector<unsigned long long> code_pages;
+    std::unordered_map<unsigned, std::unique_ptr<page_t>> pages;
+    unsigned last_vpn = ~0u;
+    page_t *last_page = nullptr;
+
+    unsigned long long hits = 0, misses = 0, invalidations = 0;
+
+    page_t *find_page(unsigned vpn);
+    void fill(page_t *page, unsigned slot, unsigned pc);
+    void drop(unsigned vpn, unsigned addr, unsigned size);
+};
+
+/*
+ * The retired instructions by class, for --profile of sim_main2: every
+ * retired pc is looked up in the decode cache, a loop is decoded once.
+ */
+class retire_profile_t {
+  public:
+    explicit retire_profile_t(decode_cache_t *cache) : cache(cache) {}
+
+    void retire(unsigned pc) {
+      ++counts[static_cast<unsigned>(cache->decode(pc).kind)];
+      ++total;
+    }
+
+    unsigned long long count(rv_class_t kind) const { return counts[static_cast<unsigned>(kind)]; }
+    unsigned long long retired() const { return total; }
+
+    void print(FILE *out) const;
+
+  private:
+    static constexpr unsigned kClasses = static_cast<unsigned>(rv_class_t::system) + 1;
+
+    decode_cache_t *cache;
+    std::array<unsigned long long, kClasses> counts{};
+    unsigned long long total = 0;
+};
+
+#endif /* DECODE_CACHE_H */
@@ -0,0 +1,181 @@
+#include "golden_model.h"
+
+golden_model_t::golden_model_t(IdeaMemory *mem, decode_cache_t *decode_cache)
+  : mem(mem), decode_cache(decode_cache) { }
+
+unsigned golden_model_t::load(unsigned addr, unsigned size, bool &is_volatile) {
+  unsigned long long bytes = 0;
+  mem->read_bytes(reinterpret_cast<char *>(&bytes), addr, size);
+  // the older stores of this cycle, in program order
+  for (auto &st : group_stores) {
+    for (unsigned b = 0; b < size; b++) {
+      unsigned off = addr + b - st.addr;
+      if (off < st.size)
+        bytes = (bytes & ~(0xffull << 8 * b)) | (st.data >> 8 * off & 0xff) << 8 * b;
+    }
+  }
+  is_volatile = false;
+  for (unsigned w : volatile_words) {
+    if (addr < w + 8 && w < addr + size) is_volatile = true;
+  }
+  return (unsigned) bytes;
+}
+
+static unsigned mulh(int a, int b) { return (unsigned) ((long long) a * b >> 32); }
+static unsigned mulhsu(int a, unsigned b) { return (unsigned) ((long long) a * (long long) b >> 32); }
+static unsigned mulhu(unsigned a, unsigned b) { return (unsigned) ((unsigned long long) a * b >> 32); }
+
+golden_retire_t golden_model_t::step() {
+  golden_retire_t r;
+  r.pc = pc;
+  history[steps++ % kHistory] = pc;
+
+  if (pc & 3) {
+    r.illegal = true;
+    return r;
+  }
+  const decoded_inst_t &d = decode_cache->decode(pc);
+  r.inst = &d;
+
+  unsigned a = regs[d.rs1], b = regs[d.rs2];
+  unsigned npc = pc + 4;
+  unsigned value = 0;
+
+  switch (d.kind) {
+    case rv_class_t::lui:   value = d.imm; break;
+    case rv_class_t::auipc: value = pc + d.imm; break;
+    case rv_class_t::jal:   value = npc; npc = pc + d.imm; break;
+    case rv_class_t::jalr:  value = npc; npc = (a + d.imm) & ~1u; break;
+
+    case rv_class_t::branch: {
+      bool taken;
+      switch (d.funct3) {
+        case 0: taken = a == b; break;
+        case 1: taken = a != b; break;
+        case 4: taken = (int) a < (int) b; break;
+        case 5: taken = (int) a >= (int) b; break;
+        case 6: taken = a < b; break;
+        case 7: taken = a >= b; break;
+        default: r.illegal = true; return r;
+      }
+      if (taken) npc = pc + d.imm;
+      break;
+    }
+
+    case rv_class_t::load: {
+      unsigned addr = a + d.imm;
+      bool is_volatile;
+      switch (d.funct3) {
+        case 0: value = (int) (signed char) load(addr, 1, is_volatile); break;
+        case 1: value = (int) (short) load(addr, 2, is_volatile); break;
+        case 2: value = load(addr, 4, is_volatile); break;
+        case 4: value = load(addr, 1, is_volatile); break;
+        case 5: value = load(addr, 2, is_volatile); break;
+        default: r.illegal = true; return r;
+      }
+      r.sync_rd = is_volatile;
+      break;
+    }
+
+    case rv_class_t::store: {
+      if (d.funct3 > 2) {
+        r.illegal = true;
+        return r;
+      }
+      r.store = true;
+      r.store_addr = a + d.imm;
+      r.store_size = 1u << d.funct3;
+      r.store_data = r.store_size == 4 ? b : b & ((1u << 8 * r.store_size) - 1);
+      group_stores.push_back({r.store_addr, r.store_size, r.store_data});
+      break;
+    }
+
+    case rv_class_t::op_imm: {
+      unsigned imm = d.imm, shamt = imm & 31;
+      switch (d.funct3) {
+        case 0: value = a + imm; break;
+        case 1: value = a << shamt; break;
+        case 2: value = (int) a < (int) imm; break;
+        case 3: value = a < imm; break;
+        case 4: value = a ^ imm; break;
+        case 5: value = imm & 0x400 ? (unsigned) ((int) a >> shamt) : a >> shamt; break;
+        case 6: value = a | imm; break;
+        case 7: value = a & imm; break;
+      }
+      break;
+    }
+
+    case rv_class_t::op: {
+      bool alt = d.funct7 & 0x20;
+      switch (d.funct3) {
+        case 0: value = alt ? a - b : a + b; break;
+        case 1: value = a << (b & 31); break;
+        case 2: value = (int) a < (int) b; break;
+        case 3: value = a < b; break;
+        case 4: value = a ^ b; break;
+        case 5: value = alt ? (unsigned) ((int) a >> (b & 31)) : a >> (b & 31); break;
+        case 6: value = a | b; break;
+        case 7: value = a & b; break;
+      }
+      break;
+    }
+
+    // division by zero and the overflow of INT_MIN / -1 do not trap, see
+    // the M extension
+    case rv_class_t::mul_div:
+      switch (d.funct3) {
+        case 0: value = a * b; break;
+        case 1: value = mulh(a, b); break;
+        case 2: value = mulhsu(a, b); break;
+        case 3: value = mulhu(a, b); break;
+        case 4:
+          if (b == 0) value = ~0u;
+          else if (a == 0x80000000u && b == ~0u) value = a;
+          else value = (int) a / (int) b;
+          break;
+        case 5: value = b == 0 ? ~0u : a / b; break;
+        case 6:
+          if (b == 0) value = a;
+          else if (a == 0x80000000u && b == ~0u) value = 0;
+          else value = (int) a % (int) b;
+          break;
+        case 7: value = b == 0 ? a : a % b; break;
+      }
+      break;
+
+    case rv_class_t::fence:
+      break;
+
+    // ecall / ebreak do nothing the core could show, a csr read is taken
+    // from the core
+    case rv_class_t::system:
+      r.sync_rd = d.funct3 != 0;
+      break;
+
+    case rv_class_t::illegal:
+      r.illegal = true;
+      return r;
+  }
+
+  if (d.writes_rd()) {
+    r.rd = d.rd;
+    r.value = value;
+    regs[d.rd] = value;
+  }
+  pc = npc;
+  return r;
+}
+
+void golden_model_t::print_state(FILE *out) const {
+  fprintf(out, "last instructions retired by the model (oldest first):\n");
+  unsigned long long first = steps > kHistory ? steps - kHistory : 0;
+  for (unsigned long long s = first; s < steps; s++) {
+    unsigned hpc = history[s % kHistory];
+    unsigned raw = 0;
+    if (!(hpc & 3)) mem->fetch_bytes(reinterpret_cast<char *>(&raw), hpc, 4);
+    fprintf(out, "  #%llu pc=0x%08x raw=0x%08x %s\n", s, hpc, raw, rv_class_name(rv32_decode(raw).kind));
+  }
+  fprintf(out, "registers of the model:\n");
+  for (unsigned i = 0; i < 32; i++)
+    fprintf(out, "  x%-2u=0x%08x%s", i, regs[i], i % 4 == 3 ? "\n" : "");
+}
@@ -0,0 +1,87 @@
+#ifndef GOLDEN_MODEL_H
+#define GOLDEN_MODEL_H
+
+#include <array>
+#include <cstdio>
+#include <vector>
+
+#include "decode_cache.h"
+#include "sim_memory.h"
+
+// what the model expects of one retired instruction
+struct golden_retire_t {
+  unsigned pc = 0;
+  const decoded_inst_t *inst = nullptr;
+  bool illegal = false;
+  unsigned rd = 0;             // 0 when no register is written
+  unsigned value = 0;
+  bool sync_rd = false;        // the value can not be predicted (a csr, a host
+                               // written word): the core's is taken
+  bool store = false;
+  unsigned store_addr = 0;
+  unsigned store_size = 0;     // in bytes
+  unsigned long long store_data = 0;
+};
+
+/*
+ * An RV32IM instruction set model that runs in lock-step with the core: it
+ * executes one instruction for every instruction the core retires, and the
+ * simulator compares the pc, the written register and the stores.
+ *
+ * The model has no memory of its own.  It reads the simulator's memory,
+ * which holds the stores that retired in the earlier cycles; the stores of
+ * the instructions that retire in the same cycle are still in the store
+ * buffer, so the model overlays its own stores of the group on its loads
+ * until end_group().
+ */
+class golden_model_t {
+  public:
+    static constexpr unsigned kHistory = 16;
+
+    golden_model_t(IdeaMemory *mem, decode_cache_t *decode_cache);
+
+    // loads of the 8 bytes at <addr> are not checked, e.g. tohost and
+    // fromhost that the front end server writes
+    void add_volatile_word(unsigned addr) { volatile_words.push_back(addr & ~7u); }
+
+    // the model starts at the pc of the first instruction that retires
+    bool started() const { return running; }
+    void start(unsigned start_pc) { pc = start_pc; running = true; }
+
+    unsigned next_pc() const { return pc; }
+    unsigned reg(unsigned i) const { return regs[i]; }
+    void set_reg(unsigned i, unsigned value) { if (i) regs[i] = value; }
+
+    // execute the instruction at next_pc()
+    golden_retire_t step();
+
+    // the stores of the group retired, they are in memory now
+    void end_group() { group_stores.clear(); }
+
+    unsigned long long retired() const { return steps; }
+
+    // the registers and the last instructions, for a mismatch report
+    void print_state(FILE *out) const;
+
+  private:
+    struct pending_store_t {
+      unsigned addr, size;
+      unsigned long long data;
+    };
+
+    IdeaMemory *mem;
+    decode_cache_t *decode_cache;
+    std::array<unsigned, 32> regs{};
+    unsigned pc = 0;
+    bool running = false;
+    unsigned long long steps = 0;
+
+    std::vector<unsigned> volatile_words;
+    std::vector<pending_store_t> group_stores;
+
+    std::array<unsigned, kHistory> history{};   // the pcs, by steps % kHistory
+
+    unsigned load(unsigned addr, unsigned size, bool &is_volatile);
+};
+
+#endif /* GOLDEN_MODEL_H */
@@ -4,6 +4,7 @@
 #include "htif.h"
 #include "elfloader.h"
 #include "byteorder.h"
+#include "checkpoint.h"
 #include <algorithm>
 #include <assert.h>
 #include <vector>
@@ -237,7 +238,10 @@ void htif_t::process_htio()
 //  while (!signal_exit && exitcode == 0)
 //  {
 //  CHANGE: now the process becomes check the tohost_addr, get the command, process the command and the respond will be put in the the queue. also, clear the cmd there. If there is respond, and the program is ready to accept (by make the fromhost 0), then deque.
-    if (auto tohost = from_target(mem.read_uint64(tohost_addr))) {
+    // an RV32 target stores tohost as two words, the device and command
+    // one first: the command is complete once the low word is written
+    auto tohost = from_target(mem.read_uint64(tohost_addr));
+    if (uint32_t(tohost)) {
       //std::cout << "has a value <"<< tohost<<"> to host" << std::endl;
       mem.write_uint64(tohost_addr, target_endian<uint64_t>::zero);
       command_t cmd(mem, tohost, fromhost_callback);
@@ -247,13 +251,7 @@ void htif_t::process_htio()
     //  idle();
    // }
 
-    device_list.tick();
-
-    if (!fromhost_queue.empty() && !mem.read_uint64(fromhost_addr)) {
-     // std::cout << "start to write back" << std::endl;
-      mem.write_uint64(fromhost_addr, to_target(fromhost_queue.front()));
-      fromhost_queue.pop();
-    }
+    tick_devices();
 //  }
 
 //  stop();
@@ -261,6 +259,53 @@ void htif_t::process_htio()
 //  return exit_code();
 }
 
+void htif_t::tick_devices()
+{
+  device_list.tick();
+
+  if (!fromhost_queue.empty() && !mem.read_uint64(fromhost_addr)) {
+   // std::cout << "start to write back" << std::endl;
+    mem.write_uint64(fromhost_addr, to_target(fromhost_queue.front()));
+    fromhost_queue.pop();
+  }
+}
+
+void htif_t::save_state(std::ostream& os)
+{
+  ckpt_write(os, entry);
+  ckpt_write(os, tohost_addr);
+  ckpt_write(os, fromhost_addr);
+  ckpt_write(os, exitcode);
+  ckpt_write(os, stopped);
+
+  std::queue<reg_t> pending = fromhost_queue;
+  ckpt_write<uint64_t>(os, pending.size());
+  for (; !pending.empty(); pending.pop())
+    ckpt_write(os, pending.front());
+
+  syscall_proxy.save_state(os);
+}
+
+void htif_t::restore_state(std::istream& is)
+{
+  ckpt_read(is, entry);
+  ckpt_read(is, tohost_addr);
+  ckpt_read(is, fromhost_addr);
+  ckpt_read(is, exitcode);
+  ckpt_read(is, stopped);
+
+  uint64_t num;
+  ckpt_read(is, num);
+  fromhost_queue = std::queue<reg_t>();
+  for (uint64_t i = 0; i < num; i++) {
+    reg_t resp;
+    ckpt_read(is, resp);
+    fromhost_queue.push(resp);
+  }
+
+  syscall_proxy.restore_state(is);
+}
+
 bool htif_t::done()
 {
   return stopped;
@@ -26,12 +26,36 @@ class htif_t : public chunked_memif_t
   // CHANGE: for a single thread version, cannot use the structure here, so no run()
   // int run();
   void process_htio(); // CHANGE: use a function to process the host target io
+  // the part of process_htio that does not look at tohost: tick the
+  // devices and pass a queued response to fromhost once it is free.  It
+  // has to run on a schedule of its own, a device may answer or act
+  // between two commands
+  void tick_devices();
   bool done(); // just return the stopped flag
   int exit_code(); // the exit code
   bool is_signal_exit();
 
+  // the words the target talks to the host through, a store to one of
+  // them is what process_htio has to look at
+  addr_t get_tohost_addr() const { return tohost_addr; }
+  addr_t get_fromhost_addr() const { return fromhost_addr; }
+
   virtual memif_t& memif() { return mem; }
 
+  // proxied file I/O on a worker thread, see syscall_t::set_async; while
+  // io_pending() tick_devices has to be called to deliver the response
+  void set_async_syscalls(bool on) { syscall_proxy.set_async(on); }
+  bool io_pending() const { return syscall_proxy.io_pending(); }
+  void finish_io() { syscall_proxy.finish_io(); }
+
+  // the console of the target, see syscall_t::set_console
+  void set_console(console_t* c) { syscall_proxy.set_console(c); }
+
+  // save / restore the host side of the target communication: the
+  // tohost/fromhost addresses, pending responses, exit state and open files
+  void save_state(std::ostream& os);
+  void restore_state(std::istream& is);
+
   template<typename T> inline T from_target(target_endian<T> n) const
   {
 #ifdef RISCV_ENABLE_DUAL_ENDIAN
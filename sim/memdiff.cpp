@@ -0,0 +1,135 @@
+#include "memdump.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+/*
+ * Compare two memory dumps written by memdump_write, e.g. the final memory
+ * of two runs:
+ *
+ *   ./memdiff logs/memory_final.mdmp other/memory_final.mdmp
+ *
+ * Both dumps are streamed side by side in address order, pages missing
+ * from one dump are zero.  Every differing 32-byte line is printed, the
+ * exit status is 1 when the dumps differ.
+ *
+ *   ./memdiff --print <dump> [addr]
+ *
+ * prints the non-zero lines of a dump as IdeaMemory::print_all does, or
+ * only the page holding <addr>, found through the index.
+ */
+
+static constexpr unsigned line_bytes = 32;
+static constexpr unsigned byte_group = 4;
+static constexpr unsigned no_page = ~0u;
+
+static void print_line(const char *line) {
+  for (unsigned j = 0; j < line_bytes; ++j) {
+    std::printf("%02x", (unsigned char) line[j]);
+    if ((j + 1) % byte_group == 0) std::printf(" ");
+  }
+}
+
+static void print_page(unsigned addr, const char *page) {
+  for (unsigned i = 0; i < memdump_page_size; i += line_bytes) {
+    const char *line = page + i;
+    if (std::all_of(line, line + line_bytes, [](char c) { return c == 0; })) continue;
+    std::printf("0x%08x     :  ", addr + i);
+    print_line(line);
+    std::printf("\n");
+  }
+}
+
+static int print_dump(const std::string &file, const char *addr_arg) {
+  std::ifstream is{file, std::ios::binary};
+  if (!is) {
+    std::fprintf(stderr, "cannot open %s\n", file.c_str());
+    return 2;
+  }
+  memdump_reader_t reader(is);
+  std::vector<char> page(memdump_page_size);
+  unsigned addr;
+
+  if (addr_arg) {
+    unsigned want = std::stoul(addr_arg, nullptr, 0) & ~(memdump_page_size - 1);
+    for (auto &e: reader.read_index()) {
+      if (e.addr != want) continue;
+      reader.read_page_at(e.offset, addr, page.data());
+      print_page(addr, page.data());
+      return 0;
+    }
+    std::printf("page 0x%08x is zero\n", want);
+    return 0;
+  }
+
+  while (reader.next(addr, page.data())) {
+    print_page(addr, page.data());
+  }
+  return 0;
+}
+
+// reads one dump, a missing page is reported as a zero page
+struct dump_side_t {
+  memdump_reader_t reader;
+  std::vector<char> page;
+  unsigned addr = no_page;
+
+  explicit dump_side_t(std::istream &is): reader(is), page(memdump_page_size) { advance(); }
+
+  void advance() {
+    if (!reader.next(addr, page.data())) addr = no_page;
+  }
+};
+
+static int diff_dumps(const std::string &file_a, const std::string &file_b) {
+  std::ifstream is_a{file_a, std::ios::binary}, is_b{file_b, std::ios::binary};
+  if (!is_a || !is_b) {
+    std::fprintf(stderr, "cannot open %s\n", (!is_a ? file_a : file_b).c_str());
+    return 2;
+  }
+  dump_side_t a(is_a), b(is_b);
+  const std::vector<char> zero(memdump_page_size);
+  unsigned long long lines = 0, pages = 0;
+
+  // no_page is not page aligned, it sorts after every page
+  while (a.addr != no_page || b.addr != no_page) {
+    unsigned addr = std::min(a.addr, b.addr);
+    const char *pa = a.addr == addr ? a.page.data() : zero.data();
+    const char *pb = b.addr == addr ? b.page.data() : zero.data();
+    bool page_differs = false;
+    for (unsigned i = 0; i < memdump_page_size; i += line_bytes) {
+      if (!std::memcmp(pa + i, pb + i, line_bytes)) continue;
+      std::printf("0x%08x  < ", addr + i);
+      print_line(pa + i);
+      std::printf("\n            > ");
+      print_line(pb + i);
+      std::printf("\n");
+      ++lines;
+      page_differs = true;
+    }
+    pages += page_differs;
+    if (a.addr == addr) a.advance();
+    if (b.addr == addr) b.advance();
+  }
+
+  std::printf("%llu lines in %llu pages differ\n", lines, pages);
+  return lines ? 1 : 0;
+}
+
+int main(int argc, char **argv) {
+  try {
+    if (argc >= 3 && std::strcmp(argv[1], "--print") == 0)
+      return print_dump(argv[2], argc > 3 ? argv[3] : nullptr);
+    if (argc == 3)
+      return diff_dumps(argv[1], argv[2]);
+  } catch (std::exception &e) {
+    std::fprintf(stderr, "memdiff: %s\n", e.what());
+    return 2;
+  }
+  std::fprintf(stderr, "usage: %s <dump> <dump>\n       %s --print <dump> [addr]\n", argv[0], argv[0]);
+  return 2;
+}
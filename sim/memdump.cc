@@ -0,0 +1,285 @@
+#include "memdump.h"
+#include "checkpoint.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+#ifdef HAVE_LZ4
+#include <lz4.h>
+#endif
+
+static const char header_magic[8] = {'R', 'I', 'A', 'M', 'D', 'U', 'M', 'P'};
+static const char trailer_magic[8] = {'R', 'I', 'A', 'M', 'D', 'I', 'D', 'X'};
+static constexpr unsigned memdump_version = 1;
+static constexpr unsigned char memdump_end = 0xff;
+
+/*
+ * PackBits: a control byte c in [0, 127] is followed by c + 1 literal bytes,
+ * c in [-127, -1] by one byte repeated 1 - c times.
+ */
+static void rle_encode(const char *in, unsigned n, std::vector<char> &out) {
+  out.clear();
+  unsigned i = 0;
+  while (i < n) {
+    unsigned run = 1;
+    while (i + run < n && run < 128 && in[i + run] == in[i]) ++run;
+    if (run >= 3) {
+      out.push_back((char) (257 - run));
+      out.push_back(in[i]);
+      i += run;
+      continue;
+    }
+    // literals up to the next run of 3
+    unsigned st = i;
+    while (i < n && i - st < 128) {
+      if (i + 2 < n && in[i] == in[i + 1] && in[i] == in[i + 2]) break;
+      ++i;
+    }
+    out.push_back((char) (i - st - 1));
+    out.insert(out.end(), in + st, in + i);
+  }
+}
+
+static void rle_decode(const char *in, unsigned n, char *out, unsigned out_size) {
+  unsigned i = 0, o = 0;
+  while (i < n) {
+    signed char c = in[i++];
+    if (c >= 0) {
+      unsigned len = c + 1;
+      if (i + len > n || o + len > out_size) break;
+      std::memcpy(out + o, in + i, len);
+      i += len;
+      o += len;
+    } else if (c != -128) {
+      unsigned len = 1 - c;
+      if (i >= n || o + len > out_size) break;
+      std::memset(out + o, in[i++], len);
+      o += len;
+    }
+  }
+  if (i != n || o != out_size)
+    throw std::runtime_error("memdump: corrupted rle page");
+}
+
+// encode <page>, return the codec actually used: raw when nothing is saved
+static memdump_codec_t encode_page(memdump_codec_t codec, const char *page, std::vector<char> &out) {
+  switch (codec) {
+    case memdump_codec_t::raw:
+      break;
+    case memdump_codec_t::rle:
+      rle_encode(page, memdump_page_size, out);
+      break;
+#ifdef HAVE_ZSTD
+    case memdump_codec_t::zstd: {
+      out.resize(ZSTD_compressBound(memdump_page_size));
+      size_t n = ZSTD_compress(out.data(), out.size(), page, memdump_page_size, 1);
+      if (ZSTD_isError(n)) return memdump_codec_t::raw;
+      out.resize(n);
+      break;
+    }
+#endif
+#ifdef HAVE_LZ4
+    case memdump_codec_t::lz4: {
+      out.resize(LZ4_compressBound(memdump_page_size));
+      int n = LZ4_compress_default(page, out.data(), memdump_page_size, out.size());
+      if (n <= 0) return memdump_codec_t::raw;
+      out.resize(n);
+      break;
+    }
+#endif
+    default:
+      throw std::invalid_argument("memdump: codec not supported by this build");
+  }
+  return codec == memdump_codec_t::raw || out.size() >= memdump_page_size ? memdump_codec_t::raw : codec;
+}
+
+static void decode_page(memdump_codec_t codec, const std::vector<char> &in, char *page) {
+  switch (codec) {
+    case memdump_codec_t::raw:
+      if (in.size() != memdump_page_size) break;
+      std::memcpy(page, in.data(), memdump_page_size);
+      return;
+    case memdump_codec_t::rle:
+      rle_decode(in.data(), in.size(), page, memdump_page_size);
+      return;
+#ifdef HAVE_ZSTD
+    case memdump_codec_t::zstd:
+      if (ZSTD_decompress(page, memdump_page_size, in.data(), in.size()) != memdump_page_size) break;
+      return;
+#endif
+#ifdef HAVE_LZ4
+    case memdump_codec_t::lz4:
+      if (LZ4_decompress_safe(in.data(), page, in.size(), memdump_page_size) != (int) memdump_page_size) break;
+      return;
+#endif
+    default:
+      throw std::runtime_error("memdump: codec not supported by this build");
+  }
+  throw std::runtime_error("memdump: corrupted page");
+}
+
+memdump_codec_t memdump_default_codec() {
+#if defined(HAVE_ZSTD)
+  return memdump_codec_t::zstd;
+#elif defined(HAVE_LZ4)
+  return memdump_codec_t::lz4;
+#else
+  return memdump_codec_t::rle;
+#endif
+}
+
+memdump_codec_t memdump_codec_by_name(const std::string &name) {
+  if (name == "raw") return memdump_codec_t::raw;
+  if (name == "rle") return memdump_codec_t::rle;
+  if (name == "zstd") return memdump_codec_t::zstd;
+  if (name == "lz4") return memdump_codec_t::lz4;
+  throw std::invalid_argument("unknown memdump codec: " + name);
+}
+
+void memdump_write(IdeaMemory &mem, std::ostream &os, memdump_codec_t codec) {
+  std::streamoff base = os.tellp();
+  os.write(header_magic, sizeof header_magic);
+  ckpt_write(os, memdump_version);
+  ckpt_write(os, memdump_page_size);
+
+  std::vector<memdump_index_entry_t> index;
+  std::vector<char> encoded;
+  auto put_page = [&](unsigned addr, const char *page) {
+    if (std::all_of(page, page + memdump_page_size, [](char c) { return c == 0; })) return;
+    index.push_back({addr, (unsigned long long) (os.tellp() - base)});
+    memdump_codec_t used = encode_page(codec, page, encoded);
+    const char *data = used == memdump_codec_t::raw ? page : encoded.data();
+    unsigned size = used == memdump_codec_t::raw ? memdump_page_size : encoded.size();
+    ckpt_write(os, addr);
+    ckpt_write(os, used);
+    ckpt_write(os, size);
+    os.write(data, size);
+  };
+
+  // the blocks of a memory come in address order, but need not be pages
+  std::vector<char> page(memdump_page_size);
+  unsigned page_addr = 0;
+  bool have_page = false;
+  mem.for_each_block([&](unsigned addr, const char *data, unsigned size) {
+    while (size) {
+      unsigned st = addr & ~(memdump_page_size - 1);
+      if (!have_page || st != page_addr) {
+        if (have_page) put_page(page_addr, page.data());
+        std::fill(page.begin(), page.end(), 0);
+        page_addr = st;
+        have_page = true;
+      }
+      unsigned off = addr - st;
+      unsigned n = std::min(memdump_page_size - off, size);
+      std::memcpy(page.data() + off, data, n);
+      addr += n;
+      data += n;
+      size -= n;
+    }
+  });
+  if (have_page) put_page(page_addr, page.data());
+
+  ckpt_write(os, 0u);
+  ckpt_write(os, memdump_end);
+  ckpt_write(os, 0u);
+
+  unsigned long long index_offset = os.tellp() - base;
+  ckpt_write(os, (unsigned) index.size());
+  for (auto &e: index) {
+    ckpt_write(os, e.addr);
+    ckpt_write(os, e.offset);
+  }
+  ckpt_write(os, index_offset);
+  os.write(trailer_magic, sizeof trailer_magic);
+}
+
+void memdump_write(IdeaMemory &mem, const std::string &file, memdump_codec_t codec) {
+  std::ofstream os{file, std::ios::binary};
+  if (!os)
+    throw std::runtime_error("memdump: cannot open " + file);
+  memdump_write(mem, os, codec);
+}
+
+void memdump_load(std::istream &is, IdeaMemory &mem) {
+  mem.clear();
+  memdump_reader_t reader(is);
+  std::vector<char> page(memdump_page_size);
+  unsigned addr;
+  while (reader.next(addr, page.data())) {
+    mem.write_bytes(page.data(), memdump_page_size, addr);
+  }
+}
+
+void memdump_load(const std::string &file, IdeaMemory &mem) {
+  std::ifstream is{file, std::ios::binary};
+  if (!is)
+    throw std::runtime_error("memdump: cannot open " + file);
+  memdump_load(is, mem);
+}
+
+memdump_reader_t::memdump_reader_t(std::istream &is): is(is), base(is.tellg()) {
+  char magic[sizeof header_magic];
+  unsigned version, page_size;
+  if (!is.read(magic, sizeof magic) || std::memcmp(magic, header_magic, sizeof magic))
+    throw std::runtime_error("memdump: not a memory dump");
+  ckpt_read(is, version);
+  ckpt_read(is, page_size);
+  if (version != memdump_version || page_size != memdump_page_size)
+    throw std::runtime_error("memdump: unsupported version");
+}
+
+bool memdump_reader_t::next(unsigned &addr, char *page) {
+  if (ended) return false;
+  unsigned char codec;
+  unsigned size;
+  ckpt_read(is, addr);
+  ckpt_read(is, codec);
+  ckpt_read(is, size);
+  if (codec == memdump_end) {
+    // skip the index and the trailer
+    unsigned count;
+    ckpt_read(is, count);
+    is.ignore((std::streamsize) count * (sizeof(unsigned) + sizeof(unsigned long long))
+              + sizeof(unsigned long long) + sizeof trailer_magic);
+    ended = true;
+    return false;
+  }
+  stored.resize(size);
+  if (!is.read(stored.data(), size))
+    throw std::runtime_error("memdump: truncated page");
+  decode_page(static_cast<memdump_codec_t>(codec), stored, page);
+  return true;
+}
+
+std::vector<memdump_index_entry_t> memdump_reader_t::read_index() {
+  char magic[sizeof trailer_magic];
+  unsigned long long index_offset;
+  is.clear();
+  is.seekg(-(std::streamoff) (sizeof index_offset + sizeof magic), std::ios::end);
+  ckpt_read(is, index_offset);
+  if (!is.read(magic, sizeof magic) || std::memcmp(magic, trailer_magic, sizeof magic))
+    throw std::runtime_error("memdump: missing index");
+
+  is.seekg(base + (std::streamoff) index_offset);
+  unsigned count;
+  ckpt_read(is, count);
+  std::vector<memdump_index_entry_t> index(count);
+  for (auto &e: index) {
+    ckpt_read(is, e.addr);
+    ckpt_read(is, e.offset);
+  }
+  return index;
+}
+
+void memdump_reader_t::read_page_at(unsigned long long offset, unsigned &addr, char *page) {
+  is.clear();
+  is.seekg(base + (std::streamoff) offset);
+  ended = false;
+  if (!next(addr, page))
+    throw std::runtime_error("memdump: no page at this offset");
+}
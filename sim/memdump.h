@@ -0,0 +1,72 @@
+#ifndef MEMDUMP_H
+#define MEMDUMP_H
+
+#include "sim_memory.h"
+
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+/*
+ * Binary dump of an IdeaMemory.
+ *
+ * The memory is cut into 4KiB pages, written in address order; pages that
+ * are all zero are left out.  The records are followed by a sparse index
+ * of the pages, so a dump is written in one pass and a page can still be
+ * found without decoding the ones before it.
+ *
+ *   header  : "RIAMDUMP", u32 version, u32 page size
+ *   record  : u32 page addr, u8 codec, u32 stored size, stored bytes
+ *   end     : u32 0, u8 memdump_end, u32 0
+ *   index   : u32 count, count x (u32 page addr, u64 record offset)
+ *   trailer : u64 index offset, "RIAMDIDX"
+ *
+ * Offsets are counted from the header.  Values are in host byte order.
+ */
+
+static constexpr unsigned memdump_page_size = 4096;
+
+enum class memdump_codec_t : unsigned char { raw = 0, rle = 1, zstd = 2, lz4 = 3 };
+
+// the best codec this binary is built with: zstd, lz4 or else rle
+memdump_codec_t memdump_default_codec();
+
+// parse "raw", "rle", "zstd" or "lz4"
+memdump_codec_t memdump_codec_by_name(const std::string &name);
+
+void memdump_write(IdeaMemory &mem, std::ostream &os, memdump_codec_t codec = memdump_default_codec());
+void memdump_write(IdeaMemory &mem, const std::string &file, memdump_codec_t codec = memdump_default_codec());
+
+// replace the content of <mem> with the dump
+void memdump_load(std::istream &is, IdeaMemory &mem);
+void memdump_load(const std::string &file, IdeaMemory &mem);
+
+struct memdump_index_entry_t {
+  unsigned addr;
+  unsigned long long offset;
+};
+
+// decode the records of a dump one page at a time
+class memdump_reader_t {
+  public:
+    // read the header at the current position of <is>
+    explicit memdump_reader_t(std::istream &is);
+
+    // decode the next non-zero page, false after the last one; the stream
+    // is then left right after the dump
+    bool next(unsigned &addr, char *page);
+
+    // the index of a dump file, read from its trailer
+    std::vector<memdump_index_entry_t> read_index();
+
+    // decode the record at <offset> of the index
+    void read_page_at(unsigned long long offset, unsigned &addr, char *page);
+
+  private:
+    std::istream &is;
+    std::streamoff base;
+    bool ended = false;
+    std::vector<char> stored;
+};
+
+#endif /* MEMDUMP_H */
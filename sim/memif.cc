@@ -4,9 +4,32 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdexcept>
+#include <vector>
 #include <iostream>
 #include "memif.h"
 
+size_t chunked_memif_t::read_string(addr_t taddr, size_t max_len, char* dst)
+{
+  size_t align = chunk_align(), max_chunk = chunk_max_size();
+  std::vector<char> chunk(max_chunk);
+  addr_t base = taddr & ~(align-1);
+  size_t skip = taddr - base, len = 0;
+  while (len < max_len)
+  {
+    read_chunk(base, max_chunk, chunk.data());
+    size_t n = std::min(max_chunk - skip, max_len - len);
+    const char* nul = (const char*)memchr(chunk.data() + skip, 0, n);
+    size_t this_len = nul ? nul - (chunk.data() + skip) : n;
+    memcpy(dst + len, chunk.data() + skip, nul ? this_len + 1 : this_len);
+    len += this_len;
+    if (nul)
+      return len;
+    base += max_chunk;
+    skip = 0;
+  }
+  return max_len;
+}
+
 // READNOTE: if the chunk_align == 1, then this method just read out chunks by chunk from the memory
 void memif_t::read(addr_t addr, size_t len, void* bytes)
 {
@@ -184,7 +207,6 @@ target_endian<int64_t> memif_t::read_int64(addr_t addr)
 
 void memif_t::write_uint64(addr_t addr, target_endian<uint64_t> val)
 {
-  std::cout << "write uint64" << std::endl;
   MEMIF_WRITE_FUNC;
 }
 
@@ -5,6 +5,8 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <vector>
+#include <sys/uio.h>
 #include "byteorder.h"
 
 typedef uint64_t reg_t;
@@ -27,6 +29,15 @@ public:
   virtual size_t chunk_align() = 0;
   virtual size_t chunk_max_size() = 0;
 
+  // see memif_t::read_string, this one reads chunk by chunk; a memory
+  // that can look for the NUL in place overrides it
+  virtual size_t read_string(addr_t taddr, size_t max_len, char* dst);
+
+  // see memif_t::host_iovecs, a target that is not in this process has none
+  virtual bool host_iovecs(addr_t taddr, size_t len, bool write, std::vector<iovec>& iov) {
+    return false;
+  }
+
   virtual void set_target_endianness(memif_endianness_t endianness) {}
   virtual memif_endianness_t get_target_endianness() const {
     return memif_endianness_undecided;
@@ -44,6 +55,19 @@ public:
   virtual void read(addr_t addr, size_t len, void* bytes);
   virtual void write(addr_t addr, size_t len, const void* bytes);
 
+  // read the NUL terminated string at <addr>, at most <max_len> bytes with
+  // the NUL; return its length, or <max_len> when it has no NUL in the range
+  virtual size_t read_string(addr_t addr, size_t max_len, char* dst) {
+    return cmemif->read_string(addr, max_len, dst);
+  }
+
+  // append the host ranges that hold [addr, addr + len) to <iov>, for a
+  // readv (<write>) or a writev on the target memory in place.  Return
+  // false when the target has no such ranges, then use read / write.
+  virtual bool host_iovecs(addr_t addr, size_t len, bool write, std::vector<iovec>& iov) {
+    return cmemif->host_iovecs(addr, len, write, iov);
+  }
+
   // read and write 8-bit words
   virtual target_endian<uint8_t> read_uint8(addr_t addr);
   virtual target_endian<int8_t> read_int8(addr_t addr);
@@ -0,0 +1,303 @@
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/*
+ * Run a regression of many programs on the verilated model, in parallel:
+ *
+ *   ./regress [-j <jobs>] [--sim=<Vtop>] [--out=<dir>] [--max-cycles=<n>]
+ *             [--report=<json>] <manifest> [-- <simulator options>]
+ *
+ * Every line of the manifest is one job, paths are relative to the
+ * directory of the manifest:
+ *
+ *   # <elf> <expected exit code> [max-cycles=<n>] [input=<file>]...
+ *   spike-software/sobel.elf 0 input=data/lena.img.bin
+ *
+ * Each job runs sim_main2 (--quiet --max-cycles=<n>) in a directory of its
+ * own, <out>/<job>, so that the logs, dumps and files the program writes
+ * do not collide; the input files are copied there at the same relative
+ * path.  A job passes when the simulator exits with the expected code, a
+ * job out of cycles exits with 124 (see sim_main2.cc).
+ *
+ * At most <jobs> simulators run at a time, the table of the results with
+ * the cycles and the IPC of every job is printed at the end, and written as
+ * JSON with --report.  The exit status is 1 when a job failed.
+ */
+
+struct regress_job_t {
+  std::string name;                 // the elf path, '/' replaced by '_'
+  std::string elf;
+  int expected = 0;
+  unsigned long long max_cycles = 0;
+  std::vector<std::string> inputs;
+
+  // the result
+  pid_t pid = -1;
+  std::chrono::steady_clock::time_point start;
+  double seconds = 0;
+  int status = -1;                  // the exit status, -1 when it did not exit
+  int signal = 0;
+  std::string stop_reason;
+  unsigned long long cycles = 0, insts = 0;
+
+  bool passed() const { return status == expected; }
+};
+
+struct regress_options_t {
+  unsigned jobs = std::max(1u, std::thread::hardware_concurrency());
+  std::string sim = "obj_dir/Vtop";
+  std::string out = "regress_out";
+  unsigned long long max_cycles = 10000000;
+  std::string report;
+  std::string manifest;
+  std::vector<std::string> sim_args;
+};
+
+static std::string dir_of(const std::string &path) {
+  auto slash = path.rfind('/');
+  return slash == std::string::npos ? "." : path.substr(0, slash);
+}
+
+static std::string absolute(const std::string &base, const std::string &path) {
+  if (!path.empty() && path[0] == '/') return path;
+  std::string full = base + "/" + path;
+  if (full[0] == '/') return full;
+  char cwd[4096];
+  if (!getcwd(cwd, sizeof cwd)) throw std::runtime_error("getcwd failed");
+  return std::string(cwd) + "/" + full;
+}
+
+static void make_dirs(const std::string &path) {
+  for (size_t pos = path.find('/', 1); ; pos = path.find('/', pos + 1)) {
+    std::string dir = path.substr(0, pos);
+    if (mkdir(dir.c_str(), 0777) != 0 && errno != EEXIST)
+      throw std::runtime_error("cannot create " + dir + ": " + std::strerror(errno));
+    if (pos == std::string::npos) break;
+  }
+}
+
+static std::vector<regress_job_t> read_manifest(const regress_options_t &opts) {
+  std::ifstream is{opts.manifest};
+  if (!is) throw std::runtime_error("cannot open " + opts.manifest);
+  std::string base = dir_of(opts.manifest);
+  std::vector<regress_job_t> jobs;
+  std::string line;
+  for (unsigned no = 1; std::getline(is, line); ++no) {
+    line = line.substr(0, line.find('#'));
+    std::istringstream ls{line};
+    regress_job_t job;
+    if (!(ls >> job.elf)) continue;
+    if (!(ls >> job.expected))
+      throw std::runtime_error(opts.manifest + ":" + std::to_string(no) + ": no expected exit code");
+    job.max_cycles = opts.max_cycles;
+    for (std::string field; ls >> field; ) {
+      if (field.rfind("max-cycles=", 0) == 0) {
+        job.max_cycles = std::stoull(field.substr(std::strlen("max-cycles=")));
+      } else if (field.rfind("input=", 0) == 0) {
+        job.inputs.push_back(field.substr(std::strlen("input=")));
+      } else {
+        throw std::runtime_error(opts.manifest + ":" + std::to_string(no) + ": unknown field " + field);
+      }
+    }
+    job.name = job.elf.substr(0, job.elf.rfind(".elf"));
+    std::replace(job.name.begin(), job.name.end(), '/', '_');
+    job.elf = absolute(base, job.elf);
+    jobs.push_back(job);
+  }
+  return jobs;
+}
+
+static void copy_file(const std::string &from, const std::string &to) {
+  std::ifstream is{from, std::ios::binary};
+  if (!is) throw std::runtime_error("cannot open input " + from);
+  make_dirs(dir_of(to));
+  std::ofstream os{to, std::ios::binary};
+  os << is.rdbuf();
+}
+
+// set up the directory of the job and start the simulator in it
+static void start_job(regress_job_t &job, const regress_options_t &opts) {
+  std::string base = dir_of(opts.manifest);
+  std::string dir = absolute(".", opts.out + "/" + job.name);
+  make_dirs(dir);
+  for (auto &input : job.inputs) {
+    copy_file(absolute(base, input), dir + "/" + input);
+  }
+
+  std::string sim = absolute(".", opts.sim);
+  std::vector<std::string> args{sim, job.elf, "--quiet", "--max-cycles=" + std::to_string(job.max_cycles)};
+  args.insert(args.end(), opts.sim_args.begin(), opts.sim_args.end());
+  std::vector<char *> argv;
+  for (auto &arg : args) argv.push_back(&arg[0]);
+  argv.push_back(nullptr);
+
+  job.start = std::chrono::steady_clock::now();
+  job.pid = fork();
+  if (job.pid < 0) throw std::runtime_error(std::string("fork failed: ") + std::strerror(errno));
+  if (job.pid == 0) {
+    int log = open((dir + "/sim.log").c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (log < 0 || chdir(dir.c_str()) != 0) _exit(127);
+    dup2(log, STDOUT_FILENO);
+    dup2(log, STDERR_FILENO);
+    close(log);
+    execv(argv[0], argv.data());
+    std::fprintf(stderr, "cannot run %s: %s\n", argv[0], std::strerror(errno));
+    _exit(127);
+  }
+}
+
+// pick the summary lines sim_main2 prints at exit out of the log
+static void read_job_log(regress_job_t &job, const regress_options_t &opts) {
+  std::ifstream is{opts.out + "/" + job.name + "/sim.log"};
+  const std::string stopped = "stopped by: ";
+  for (std::string line; std::getline(is, line); ) {
+    if (line.rfind(stopped, 0) == 0) {
+      job.stop_reason = line.substr(stopped.size());
+    } else if (line.rfind("simulated ", 0) == 0) {
+      std::sscanf(line.c_str(), "simulated %llu cycles, %llu instructions", &job.cycles, &job.insts);
+    }
+  }
+}
+
+static void run_jobs(std::vector<regress_job_t> &jobs, const regress_options_t &opts) {
+  size_t next = 0, running = 0, done = 0;
+  while (done < jobs.size()) {
+    while (running < opts.jobs && next < jobs.size()) {
+      auto &job = jobs[next++];
+      try {
+        start_job(job, opts);
+        ++running;
+      } catch (std::exception &e) {
+        // e.g. a missing input, the job fails without running
+        job.stop_reason = e.what();
+        std::printf("[%zu/%zu] %-32s FAIL (%s)\n", ++done, jobs.size(), job.name.c_str(), e.what());
+      }
+    }
+    if (!running) continue;
+    int wstatus;
+    pid_t pid = wait(&wstatus);
+    if (pid < 0) throw std::runtime_error(std::string("wait failed: ") + std::strerror(errno));
+    auto job = std::find_if(jobs.begin(), jobs.end(), [pid](const regress_job_t &j) { return j.pid == pid; });
+    if (job == jobs.end()) continue;
+    job->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - job->start).count();
+    if (WIFEXITED(wstatus)) job->status = WEXITSTATUS(wstatus);
+    if (WIFSIGNALED(wstatus)) job->signal = WTERMSIG(wstatus);
+    read_job_log(*job, opts);
+    std::printf("[%zu/%zu] %-32s %s (%.1f s)\n", ++done, jobs.size(), job->name.c_str(),
+                job->passed() ? "PASS" : "FAIL", job->seconds);
+    std::fflush(stdout);
+    --running;
+  }
+}
+
+static double ipc(const regress_job_t &job) {
+  return job.cycles ? (double) job.insts / job.cycles : 0.0;
+}
+
+static void print_report(const std::vector<regress_job_t> &jobs, double seconds) {
+  std::printf("\n%-32s %-6s %6s %6s %14s %14s %7s %8s  %s\n",
+              "job", "result", "exit", "expect", "cycles", "instructions", "IPC", "time(s)", "stopped by");
+  unsigned passed = 0;
+  for (auto &job : jobs) {
+    passed += job.passed();
+    std::string exit = job.signal ? "sig" + std::to_string(job.signal) : std::to_string(job.status);
+    std::printf("%-32s %-6s %6s %6d %14llu %14llu %7.3f %8.1f  %s\n", job.name.c_str(),
+                job.passed() ? "PASS" : "FAIL", exit.c_str(), job.expected, job.cycles, job.insts,
+                ipc(job), job.seconds, job.stop_reason.c_str());
+  }
+  std::printf("\n%u of %zu jobs passed in %.1f s\n", passed, jobs.size(), seconds);
+}
+
+static std::string json_string(const std::string &s) {
+  std::string out = "\"";
+  for (char c : s) {
+    if (c == '"' || c == '\\') out += '\\';
+    out += c;
+  }
+  return out + "\"";
+}
+
+static void write_json_report(const std::vector<regress_job_t> &jobs, double seconds, std::ostream &os) {
+  os << "{\n  \"seconds\": " << seconds << ",\n  \"jobs\": [";
+  for (size_t i = 0; i < jobs.size(); ++i) {
+    auto &job = jobs[i];
+    os << (i ? ",\n" : "\n") << "    {\"name\": " << json_string(job.name)
+       << ", \"elf\": " << json_string(job.elf)
+       << ", \"passed\": " << (job.passed() ? "true" : "false")
+       << ", \"exit\": " << job.status
+       << ", \"signal\": " << job.signal
+       << ", \"expected\": " << job.expected
+       << ", \"stopped_by\": " << json_string(job.stop_reason)
+       << ", \"cycles\": " << job.cycles
+       << ", \"instructions\": " << job.insts
+       << ", \"ipc\": " << ipc(job)
+       << ", \"seconds\": " << job.seconds << "}";
+  }
+  os << "\n  ]\n}\n";
+}
+
+static regress_options_t parse_options(int argc, char **argv) {
+  regress_options_t opts;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg{argv[i]};
+    if (arg == "--") {
+      opts.sim_args.assign(argv + i + 1, argv + argc);
+      break;
+    } else if (arg == "-j" && i + 1 < argc) {
+      opts.jobs = std::max(1ul, std::stoul(argv[++i]));
+    } else if (arg.rfind("--sim=", 0) == 0) {
+      opts.sim = arg.substr(std::strlen("--sim="));
+    } else if (arg.rfind("--out=", 0) == 0) {
+      opts.out = arg.substr(std::strlen("--out="));
+    } else if (arg.rfind("--max-cycles=", 0) == 0) {
+      opts.max_cycles = std::stoull(arg.substr(std::strlen("--max-cycles=")));
+    } else if (arg.rfind("--report=", 0) == 0) {
+      opts.report = arg.substr(std::strlen("--report="));
+    } else if (opts.manifest.empty() && arg[0] != '-') {
+      opts.manifest = arg;
+    } else {
+      throw std::runtime_error("unknown option " + arg);
+    }
+  }
+  if (opts.manifest.empty()) throw std::runtime_error("no manifest");
+  return opts;
+}
+
+int main(int argc, char **argv) {
+  try {
+    regress_options_t opts = parse_options(argc, argv);
+    auto jobs = read_manifest(opts);
+    std::printf("%zu jobs on %u workers, simulator %s\n", jobs.size(), opts.jobs, opts.sim.c_str());
+    std::fflush(stdout);
+
+    auto st = std::chrono::steady_clock::now();
+    run_jobs(jobs, opts);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - st).count();
+
+    print_report(jobs, seconds);
+    if (!opts.report.empty()) {
+      std::ofstream os{opts.report};
+      write_json_report(jobs, seconds, os);
+    }
+    return std::all_of(jobs.begin(), jobs.end(), [](const regress_job_t &j) { return j.passed(); }) ? 0 : 1;
+  } catch (std::exception &e) {
+    std::fprintf(stderr, "regress: %s\n", e.what());
+    std::fprintf(stderr, "usage: %s [-j <jobs>] [--sim=<Vtop>] [--out=<dir>] [--max-cycles=<n>] "
+                         "[--report=<json>] <manifest> [-- <simulator options>]\n", argv[0]);
+    return 2;
+  }
+}
@@ -0,0 +1,30 @@
+#ifndef RUN_BUDGET_H
+#define RUN_BUDGET_H
+
+/*
+ * The budget of a run and the cycle of its checkpoint, all in full cycles
+ * of the core.  sim_main2 counts a cycle on each falling edge it serves and
+ * looks at the budget between two cycles only, so --checkpoint-at=<n> and
+ * --max-cycles=<n> are the same point of the run: the checkpoint is taken,
+ * then the run stops.
+ */
+struct run_budget_t {
+  unsigned long long max_cycles = 0;   // 0 is no limit
+  unsigned long long max_insts = 0;
+  long long checkpoint_at = -1;        // -1 is no checkpoint
+
+  // since reset, a restored run starts from the counts of the checkpoint
+  unsigned long long cycles = 0, insts = 0;
+
+  // one more cycle, <retired> instructions retired in it
+  void count_cycle(unsigned retired) {
+    cycles++;
+    insts += retired;
+  }
+
+  bool checkpoint_due() const { return checkpoint_at >= 0 && cycles == (unsigned long long) checkpoint_at; }
+  bool cycles_spent() const { return max_cycles && cycles >= max_cycles; }
+  bool insts_spent() const { return max_insts && insts >= max_insts; }
+};
+
+#endif /* RUN_BUDGET_H */
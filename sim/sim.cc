@@ -1,5 +1,9 @@
 #include "sim.h"
+#include "decode_cache.h"
 #include <iostream>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
 
 sim_t::sim_t(const std::vector<std::string> &args, IdeaMemory *ptr) : htif_t(args), mem_ptr(ptr) {
   // setup_rom();
@@ -8,13 +12,32 @@ sim_t::sim_t(const std::vector<std::string> &args, IdeaMemory *ptr) : htif_t(arg
 void sim_t::reset() {}
 
 void sim_t::read_chunk(addr_t taddr, size_t len, void *dst) {
+  // tohost/fromhost polling reads a 64-bit word every cycle
+  if (len == sizeof(uint64_t)) {
+    uint64_t val = mem_ptr->read<uint64_t>(taddr);
+    std::memcpy(dst, &val, sizeof val);
+    return;
+  }
   mem_ptr->read_bytes((char *) dst, taddr, len);
 }
 
 void sim_t::write_chunk(addr_t taddr, size_t len, const void *src) {
+  if (decode_cache) decode_cache->invalidate(taddr, len);
   mem_ptr->write_bytes((const char *) src, len, taddr);
 }
 
+// scanned in place, see IdeaMemory::read_string
+size_t sim_t::read_string(addr_t taddr, size_t max_len, char *dst) {
+  return mem_ptr->read_string(dst, taddr, std::min<size_t>(max_len, UINT32_MAX));
+}
+
+bool sim_t::host_iovecs(addr_t taddr, size_t len, bool write, std::vector<iovec>& iov) {
+  if (taddr + len > (1ull << 32)) return false;
+  if (write && decode_cache) decode_cache->invalidate(taddr, len);
+  mem_ptr->host_iovecs(taddr, len, write ? mem_access_t::store : mem_access_t::load, iov);
+  return true;
+}
+
 size_t sim_t::chunk_align() {
   return 1;
 }
@@ -5,8 +5,11 @@
 #include "sim_memory.h"
 #include "htif.h"
 
+class decode_cache_t;
+
 class sim_t : public htif_t {
   IdeaMemory *mem_ptr;
+  decode_cache_t *decode_cache = nullptr;
 
   public:
   sim_t(const std::vector<std::string> &args, IdeaMemory *ptr);
@@ -19,7 +22,13 @@ class sim_t : public htif_t {
   virtual size_t chunk_align();
   virtual size_t chunk_max_size();
 
+  virtual size_t read_string(addr_t taddr, size_t max_len, char* dst);
+  virtual bool host_iovecs(addr_t taddr, size_t len, bool write, std::vector<iovec>& iov);
+
   void setup_rom();
+
+  // drop the decoded instructions the host (syscalls) overwrites
+  void set_decode_cache(decode_cache_t *cache) { decode_cache = cache; }
 };
 
 #endif /* SIM_H */
@@ -0,0 +1,21 @@
+#ifndef SIM_LOG_H
+#define SIM_LOG_H
+
+/*
+ * Verbosity of the simulator log:
+ *   0  quiet: the output of the program and the summary at exit
+ *   1  the events of the run: setup, checkpoints
+ *   2  the bus state every cycle and every store buffer access
+ *   3  also the pipeline registers printed by the RTL (log_verbose)
+ *
+ * Levels above SIM_MAX_LOG_LEVEL are compiled out, build with e.g.
+ * -DSIM_MAX_LOG_LEVEL=1 for a simulator that only runs workloads.
+ */
+
+#ifndef SIM_MAX_LOG_LEVEL
+#define SIM_MAX_LOG_LEVEL 3
+#endif
+
+#define SIM_LOG_ON(level, verbosity) ((level) <= SIM_MAX_LOG_LEVEL && (level) <= (verbosity))
+
+#endif /* SIM_LOG_H */
@@ -5,6 +5,7 @@
 
 #include <iostream>
 #include <memory>
+#include <cstring>
 #include <verilated.h>
 #include "Vtop.h"
 
@@ -40,14 +41,25 @@ int main(int argc, char** argv, char** env) {
 
   const std::unique_ptr<Vtop> top{new Vtop{contextp.get(), "TOP"}};
 
-  auto mem = make_BucketMemory();
+  // +memory=<paged|bucket|flat> selects the memory backend
+  std::string memory_kind{contextp->commandArgsPlusMatch("memory=")};
+  auto mem = make_IdeaMemory(memory_kind.empty() ? memory_kind : memory_kind.substr(std::strlen("+memory=")));
 
-  mem->load_image_to(std::string{argv[1]}, 0);
+  // every argument that is not a plusarg is an image, "<file>@<addr>" or
+  // "<file>" for address 0, e.g. prog/bin/c_example.bin data/lena.img.bin@0x100000
+  for (int i = 1; i < argc; ++i) {
+    if (argv[i][0] != '+') load_image_spec(*mem, argv[i]);
+  }
 
   printf("Current memory layout: \n");
 
   mem->print_all();
 
+  // +max-cycles=<n> stops the run after n cycles, by default it runs until
+  // the program halts
+  std::string max_cycles_arg{contextp->commandArgsPlusMatch("max-cycles=")};
+  unsigned long long max_cycles = max_cycles_arg.empty() ? 0 : std::stoull(max_cycles_arg.substr(std::strlen("+max-cycles=")));
+
   auto imem = std::make_unique<IMem>(mem.get());
 
   auto dmem = std::make_unique<DMem>(mem.get());
@@ -109,13 +121,17 @@ int main(int argc, char** argv, char** env) {
     }
     printf("\n");
 
-    if (contextp->time() > 1000)
-      finish_flag = 1;
+    if (max_cycles && contextp->time() / 2 >= max_cycles)
+      break;
 
     if (finish_flag)
       break;
   }
 
+  // 124 as timeout(1) when the cycle budget ran out
+  int exit_status = finish_flag || contextp->gotFinish() ? 0 : 124;
+  printf("stopped by: %s\n", finish_flag ? "halt (store to 0xFFFFFFFC)" : contextp->gotFinish() ? "$finish" : "cycle budget");
+
   printf("Current memory layout: \n");
 
   mem->print_all();
@@ -129,5 +145,5 @@ int main(int argc, char** argv, char** env) {
   contextp->coveragep()->write("logs/coverage.dat");
 #endif
 
-  return 0;
+  return exit_status;
 }
@@ -2,30 +2,289 @@
 #include "sim_memory.h"
 #include "sim.h"
 #include "store_buffer.h"
+#include "checkpoint.h"
+#include "memdump.h"
+#include "decode_cache.h"
+#include "golden_model.h"
+#include "console.h"
+#include "run_budget.h"
+#include "sim_log.h"
 #include <iostream>
+#include <sstream>
+#include <fstream>
 #include <cstdint>
+#include <cstring>
+#include <chrono>
 
 #include <verilated.h>
+#include <verilated_save.h>
 #include "Vtop.h"
 
-#define SIM_TIME 30000
+// the model is verilated with --savable, so checkpoints can be taken; 0
+// for the build-fast model
+#ifndef SIM_CHECKPOINTS
+#define SIM_CHECKPOINTS 1
+#endif
 
 // Legacy function required only so linking works on Cygwin and MSVC++
 double sc_time_stamp() { return 0; }
 
+struct sim_options_t {
+  std::string prog;               // the elf to run
+  std::string restore_file;       // --restore=<file>
+  std::vector<std::string> images; // <file>@<addr>, loaded after the elf
+  std::string stats_json;         // --stats-json=<file>
+  std::string dump_memory;        // --dump-memory=<prefix>, the memory at start and end of the run
+  int verbosity = 3;              // --verbose=<level> or --quiet, see sim_log.h
+  bool cosim = false;             // --cosim, check every retired instruction against golden_model_t
+  bool profile = false;           // --profile, the retired instructions by class, see retire_profile_t
+  bool async_syscalls = false;    // --async-syscalls, file reads and writes on a worker thread
+  std::string console_file;       // --console=<file>, the output of the program instead of stdout
+  console_t::flush_t console_flush = console_t::flush_t::newline;  // --console-flush=<newline|size>
+  // the run budget, 0 is no limit: by default the program runs until it
+  // exits through tohost.  --max-cycles=<n>, --max-insts=<n> and
+  // --checkpoint-at=<cycle>, see run_budget.h
+  run_budget_t budget;
+  double max_seconds = 0;             // --max-seconds=<wall clock>
+};
+
+// why the simulation stopped, and the exit status of the simulator
+enum class stop_reason_t { tohost, halt, finish, signal, max_cycles, max_insts, max_seconds, cosim, error };
+
+static const char *stop_reason_name(stop_reason_t reason) {
+  switch (reason) {
+    case stop_reason_t::tohost:      return "tohost exit";
+    case stop_reason_t::halt:        return "halt (store to 0xFFFFFFFC)";
+    case stop_reason_t::finish:      return "$finish";
+    case stop_reason_t::signal:      return "signal";
+    case stop_reason_t::max_cycles:  return "cycle budget";
+    case stop_reason_t::max_insts:   return "instruction budget";
+    case stop_reason_t::max_seconds: return "wall clock budget";
+    case stop_reason_t::cosim:       return "co-simulation mismatch";
+    case stop_reason_t::error:       return "simulator error";
+  }
+  return "unknown";
+}
+
+// the exit code of the program when it exits, 123 when the core diverged
+// from the golden model, 124 (as timeout(1)) when a budget runs out, 125
+// on a simulator error and 130 on a signal
+static int stop_exit_status(stop_reason_t reason, int exit_code) {
+  switch (reason) {
+    case stop_reason_t::tohost:      return exit_code;
+    case stop_reason_t::halt:
+    case stop_reason_t::finish:      return 0;
+    case stop_reason_t::max_cycles:
+    case stop_reason_t::max_insts:
+    case stop_reason_t::max_seconds: return 124;
+    case stop_reason_t::cosim:       return 123;
+    case stop_reason_t::error:       return 125;
+    case stop_reason_t::signal:      return 130;
+  }
+  return 125;
+}
+
+static sim_options_t parse_options(int argc, char **argv) {
+  sim_options_t opts;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg{argv[i]};
+    if (arg.rfind("--checkpoint-at=", 0) == 0) {
+      opts.budget.checkpoint_at = std::stoll(arg.substr(std::strlen("--checkpoint-at=")));
+    } else if (arg.rfind("--restore=", 0) == 0) {
+      opts.restore_file = arg.substr(std::strlen("--restore="));
+    } else if (arg.rfind("--verbose=", 0) == 0) {
+      opts.verbosity = std::stoi(arg.substr(std::strlen("--verbose=")));
+    } else if (arg == "--quiet") {
+      opts.verbosity = 0;
+    } else if (arg == "--cosim") {
+      opts.cosim = true;
+    } else if (arg == "--profile") {
+      opts.profile = true;
+    } else if (arg == "--async-syscalls") {
+      opts.async_syscalls = true;
+    } else if (arg.rfind("--console=", 0) == 0) {
+      opts.console_file = arg.substr(std::strlen("--console="));
+    } else if (arg.rfind("--console-flush=", 0) == 0) {
+      if (!console_t::parse_flush(arg.substr(std::strlen("--console-flush=")), opts.console_flush))
+        throw std::invalid_argument("--console-flush takes newline or size");
+    } else if (arg.rfind("--max-cycles=", 0) == 0) {
+      opts.budget.max_cycles = std::stoull(arg.substr(std::strlen("--max-cycles=")));
+    } else if (arg.rfind("--max-insts=", 0) == 0) {
+      opts.budget.max_insts = std::stoull(arg.substr(std::strlen("--max-insts=")));
+    } else if (arg.rfind("--max-seconds=", 0) == 0) {
+      opts.max_seconds = std::stod(arg.substr(std::strlen("--max-seconds=")));
+    } else if (arg.rfind("--dump-memory=", 0) == 0) {
+      opts.dump_memory = arg.substr(std::strlen("--dump-memory="));
+    } else if (arg.rfind("--stats-json=", 0) == 0) {
+      opts.stats_json = arg.substr(std::strlen("--stats-json="));
+    } else if (arg[0] != '+' && arg[0] != '-' && arg.find('@') != std::string::npos) {
+      opts.images.push_back(arg);
+    } else if (arg[0] != '+' && arg[0] != '-' && opts.prog.empty()) {
+      opts.prog = arg;
+    }
+  }
+  return opts;
+}
+
+/*
+ * A checkpoint is one file written by VerilatedSave: the simulation time,
+ * the model (verilated with --savable), then a blob with the host state:
+ * the cycle and instruction counts, the memory, the pending stores and the
+ * htif state.  It is taken between two cycles.
+ */
+static void save_checkpoint(const std::string &file, VerilatedContext *contextp, Vtop *top,
+                            unsigned long long cycles, unsigned long long insts,
+                            IdeaMemory *memory, const StoreBuffer &store_buffer, sim_t &sim) {
+#if !SIM_CHECKPOINTS
+  fprintf(stderr, "[checkpoint] cycle %llu not saved: the model is not verilated with --savable\n", cycles);
+#else
+  // the memory is saved as the I/O in flight leaves it
+  sim.finish_io();
+  std::ostringstream host(std::ios::binary);
+  ckpt_write(host, cycles);
+  ckpt_write(host, insts);
+  memory->save(host);
+  store_buffer.Save(host);
+  sim.save_state(host);
+  std::string blob = host.str();
+
+  VerilatedSave os;
+  os.open(file.c_str());
+  vluint64_t time = contextp->time();
+  vluint64_t blob_size = blob.size();
+  os << time;
+  os << *top;
+  os << blob_size;
+  os.write(blob.data(), blob.size());
+  os.close();
+
+  printf("[checkpoint] cycle %llu saved to %s\n", cycles, file.c_str());
+#endif
+}
+
+// the counts of the run are set to the ones of the checkpoint, so the
+// budgets and the IPC go on from there
+static void restore_checkpoint(const std::string &file, VerilatedContext *contextp, Vtop *top,
+                               unsigned long long &cycles, unsigned long long &insts,
+                               IdeaMemory *memory, decode_cache_t &decode_cache, StoreBuffer &store_buffer,
+                               sim_t &sim) {
+#if !SIM_CHECKPOINTS
+  throw std::runtime_error("cannot restore " + file + ": the model is not verilated with --savable");
+#else
+  VerilatedRestore os;
+  os.open(file.c_str());
+  if (!os.isOpen())
+    throw std::runtime_error("cannot open checkpoint " + file);
+  vluint64_t time, blob_size;
+  os >> time;
+  os >> *top;
+  os >> blob_size;
+  std::string blob(blob_size, 0);
+  os.read(&blob[0], blob_size);
+  os.close();
+  contextp->time(time);
+
+  std::istringstream host(blob, std::ios::binary);
+  ckpt_read(host, cycles);
+  ckpt_read(host, insts);
+  memory->load(host);
+  decode_cache.clear();
+  store_buffer.Restore(host);
+  sim.restore_state(host);
+
+  printf("[checkpoint] cycle %llu restored from %s\n", cycles, file.c_str());
+#endif
+}
+
+/*
+ * Step the golden model over the instructions that retired in the last
+ * cycle, oldest first, and compare each with the core: the pc, the written
+ * register and its value, and the store, which is still pending in the
+ * store buffer.  Print a report and return false at the first difference.
+ */
+static bool cosim_check(const Vtop *top, golden_model_t &golden, const StoreBuffer &store_buffer,
+                        unsigned long long cycle) {
+  unsigned stores = 0;
+  for (unsigned i = 0; i < StoreBuffer::kCommitWidth; i++) {
+    if (!(top->inst_retire >> i & 1))
+      continue;
+    unsigned pc = top->retire_pc[i];
+    unsigned rd = top->retire_rd >> 5 * i & 31;
+    unsigned value = top->retire_rd_data[i];
+    if (!golden.started())
+      golden.start(pc);
+
+    unsigned long long index = golden.retired();
+    const char *what = nullptr;
+    char detail[160] = "";
+    golden_retire_t r;
+    if (golden.next_pc() != pc) {
+      what = "pc";
+      snprintf(detail, sizeof detail, "model pc=0x%08x, core pc=0x%08x", golden.next_pc(), pc);
+    } else if ((r = golden.step()).illegal) {
+      what = "illegal instruction";
+    } else if (r.rd != rd) {
+      what = "destination register";
+      snprintf(detail, sizeof detail, "model x%u, core x%u", r.rd, rd);
+    } else if (r.rd && r.sync_rd) {
+      golden.set_reg(rd, value);
+    } else if (r.rd && r.value != value) {
+      what = "register value";
+      snprintf(detail, sizeof detail, "x%u: model 0x%08x, core 0x%08x", rd, r.value, value);
+    } else if (r.store) {
+      if (stores >= store_buffer.Size()) {
+        what = "store";
+        snprintf(detail, sizeof detail, "model %u bytes 0x%llx to 0x%08x, the core has no pending store",
+                 r.store_size, r.store_data, r.store_addr);
+      } else {
+        const store_request_t &req = store_buffer.Pending(stores++);
+        unsigned size = data_size_map[req.size];
+        unsigned long long data = size == 8 ? req.data : req.data & ((1ull << 8 * size) - 1);
+        if (req.addr != r.store_addr || size != r.store_size || data != r.store_data) {
+          what = "store";
+          snprintf(detail, sizeof detail, "model %u bytes 0x%llx to 0x%08x, core %u bytes 0x%llx to 0x%08x",
+                   r.store_size, r.store_data, r.store_addr, size, data, req.addr);
+        }
+      }
+    }
+
+    if (what) {
+      unsigned raw = r.inst ? r.inst->raw : 0;
+      printf("[cosim] mismatch in %s at cycle %llu, instruction #%llu (retire slot %u)\n",
+             what, cycle, index, i);
+      printf("  pc=0x%08x raw=0x%08x %s\n", pc, raw, r.inst ? rv_class_name(r.inst->kind) : "-");
+      if (detail[0])
+        printf("  %s\n", detail);
+      golden.print_state(stdout);
+      return false;
+    }
+  }
+
+  unsigned retired_stores = __builtin_popcount(top->store_retire);
+  if (stores != retired_stores) {
+    printf("[cosim] mismatch at cycle %llu: the model retired %u stores, the core %u\n",
+           cycle, stores, retired_stores);
+    golden.print_state(stdout);
+    return false;
+  }
+  golden.end_group();
+  return true;
+}
 
 int main(int argc, char **argv) {
   // This is a more complicated example, please also see the simpler examples/make_hello_c.
 
   std::ios_base::sync_with_stdio(true);
-  std::cout << "the arguments are :" << std::endl;
-  for (int i = 0; argv[i]; ++i) {
-    std::cout << argv[i] << " ";
-  }
 
-  std::cout << std::endl;
-  // Prevent unused variable warnings
-  if (false && argc && argv) {}
+  sim_options_t opts = parse_options(argc, argv);
+
+  if (SIM_LOG_ON(1, opts.verbosity)) {
+    std::cout << "the arguments are :" << std::endl;
+    for (int i = 0; argv[i]; ++i) {
+      std::cout << argv[i] << " ";
+    }
+    std::cout << std::endl;
+  }
 
   Verilated::mkdir("logs");
 
@@ -43,35 +302,145 @@ int main(int argc, char **argv) {
 
   /////////////////////////
   
-  auto memory = make_BucketMemory();
+  // +memory=<paged|bucket|flat> selects the memory backend
+  std::string memory_kind{contextp->commandArgsPlusMatch("memory=")};
+  auto memory = make_IdeaMemory(memory_kind.empty() ? memory_kind : memory_kind.substr(std::strlen("+memory=")));
 
   auto imem = std::make_unique<IMem>(memory.get());
 
   auto dmem = std::make_unique<DMem>(memory.get());
 
-  std::vector<std::string> args{std::string(argv[1])};
+  std::vector<std::string> args{opts.prog};
+
+  // the output of the program: sys_printstr and its fds 1 and 2
+  console_t console;
+  console.set_flush(opts.console_flush);
+  if (!opts.console_file.empty() && !console.redirect(opts.console_file)) {
+    fprintf(stderr, "cannot create %s\n", opts.console_file.c_str());
+    return stop_exit_status(stop_reason_t::error, 0);
+  }
+  // the characters stored to 0xFFFFFFF8 stay on stderr, apart from it
+  console_t char_console(STDERR_FILENO);
+  char_console.set_flush(opts.console_flush);
 
   sim_t sim(args, memory.get());
+  sim.set_console(&console);
+
+  // the decoded instructions of the tools that follow the retired ones,
+  // stores and syscalls drop the words they overwrite
+  decode_cache_t decode_cache(memory.get());
+  dmem->set_decode_cache(&decode_cache);
+  sim.set_decode_cache(&decode_cache);
+  if (opts.async_syscalls)
+    sim.set_async_syscalls(true);
 
   sim.start();
 
   sim.setup_rom();
 
-  printf("Current memory layout: \n");
-
-  memory->print_all();
+  // the images are not written through DMem nor sim_t
+  for (auto &image : opts.images) {
+    load_image_spec(*memory, image);
+  }
+  if (!opts.images.empty())
+    decode_cache.clear();
+
+  // see sim/memdiff.cpp to print or compare the dumps
+  if (!opts.dump_memory.empty()) {
+    memdump_write(*memory, opts.dump_memory + "_init.mdmp");
+    if (SIM_LOG_ON(1, opts.verbosity))
+      printf("Current memory layout: %s_init.mdmp\n", opts.dump_memory.c_str());
+  }
 
   unsigned i = 1;
 
-  unsigned char core2dcache_data_size = 0;
-
   StoreBuffer store_buffer(std::move(dmem));
 
-  top->log_verbose = 1;
+  top->log_verbose = SIM_LOG_ON(3, opts.verbosity);
+
+  store_buffer.SetLogging(SIM_LOG_ON(2, opts.verbosity));
+  store_buffer.SetConsole(&char_console);
 
-  // In the final version, the terminate condition may only depends on the sim object
-  while (!sim.is_signal_exit() && !sim.done() && !contextp->gotFinish()) {
-    std::cout << "==================================================== At time " << i << " ====================================================" << std::endl;
+  run_budget_t budget = opts.budget;
+
+  if (!opts.restore_file.empty()) {
+    restore_checkpoint(opts.restore_file, contextp.get(), top.get(), budget.cycles, budget.insts, memory.get(),
+                       decode_cache, store_buffer, sim);
+    // one iteration per time step
+    i = contextp->time() + 1;
+  }
+
+  // the front end server is only run when the program stores to tohost or
+  // fromhost
+  store_buffer.WatchWord(sim.get_tohost_addr());
+  store_buffer.WatchWord(sim.get_fromhost_addr());
+
+  // with --cosim the golden model follows the core from reset, so not
+  // after a restore: it does not know the registers of the checkpoint
+  std::unique_ptr<golden_model_t> golden;
+  if (opts.cosim && !opts.restore_file.empty()) {
+    fprintf(stderr, "--cosim is ignored with --restore\n");
+  } else if (opts.cosim) {
+    golden = std::make_unique<golden_model_t>(memory.get(), &decode_cache);
+    golden->add_volatile_word(sim.get_tohost_addr());
+    golden->add_volatile_word(sim.get_fromhost_addr());
+  }
+
+  std::unique_ptr<retire_profile_t> profile;
+  if (opts.profile)
+    profile = std::make_unique<retire_profile_t>(&decode_cache);
+
+  bool checkpoint_requested = false;
+
+  // poll the front end server once before the first store retires
+  bool htif_poll = true;
+
+  auto start_time = std::chrono::steady_clock::now();
+  auto deadline = start_time + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+      std::chrono::duration<double>(opts.max_seconds));
+
+  stop_reason_t reason = stop_reason_t::tohost;
+
+  while (true) {
+    if (sim.done()) {
+      reason = stop_reason_t::tohost;
+      break;
+    }
+    if (sim.is_signal_exit()) {
+      reason = stop_reason_t::signal;
+      break;
+    }
+    if (contextp->gotFinish()) {
+      reason = stop_reason_t::finish;
+      break;
+    }
+    // reading the clock every iteration would show in the profile
+    if (opts.max_seconds > 0 && i % 4096 == 0 && std::chrono::steady_clock::now() >= deadline) {
+      reason = stop_reason_t::max_seconds;
+      break;
+    }
+
+    // the checkpoint and the budgets are looked at between two cycles,
+    // before the falling edge that starts the next one, so a restored run
+    // continues from here and the same cycle number means the same point
+    if (top->clock && contextp->time() + 1 >= 4) {
+      if (budget.checkpoint_due() || checkpoint_requested) {
+        save_checkpoint("logs/checkpoint_" + std::to_string(budget.cycles) + ".vlt", contextp.get(), top.get(),
+                        budget.cycles, budget.insts, memory.get(), store_buffer, sim);
+        checkpoint_requested = false;
+      }
+      if (budget.cycles_spent()) {
+        reason = stop_reason_t::max_cycles;
+        break;
+      }
+      if (budget.insts_spent()) {
+        reason = stop_reason_t::max_insts;
+        break;
+      }
+    }
+
+    if (SIM_LOG_ON(2, opts.verbosity))
+      printf("==================================================== At time %u ====================================================\n", i);
 
     contextp->timeInc(1);  // 1 timeprecision period passes...
     top->clock = !top->clock;
@@ -82,15 +451,36 @@ int main(int argc, char **argv) {
       imem->read_transction(top->core2icache_addr, reinterpret_cast<char *>(top->icache2core_data));
       top->icache2core_data_valid = 1;
       if (top->clock == 0) {
+        budget.count_cycle(__builtin_popcount(top->inst_retire));
+        if (profile) {
+          for (unsigned s = 0; s < StoreBuffer::kCommitWidth; s++) {
+            if (top->inst_retire >> s & 1)
+              profile->retire(top->retire_pc[s]);
+          }
+        }
+        // before the retiring stores leave the store buffer
+        if (golden && !cosim_check(top.get(), *golden, store_buffer, budget.cycles)) {
+          reason = stop_reason_t::cosim;
+          break;
+        }
         // When store instructions retire, write data to memory
-        if (store_buffer.CommitStoreRequest(__builtin_popcount(top->store_retire)) == -1)
+        int commit = store_buffer.CommitStoreRequest(__builtin_popcount(top->store_retire));
+        if (commit < 0) {
+          reason = commit == -1 ? stop_reason_t::halt : stop_reason_t::error;
           break;
+        }
+        if (commit == 1)
+          checkpoint_requested = true;
         // Branch mis-prediction -> flush store buffer
         if (top->recover)
           store_buffer.FlushStoreBuffer();
         // Execute store instructions -> add store requests to store buffer
-        if (top->core2dcache_data_we)
-          store_buffer.AddStoreRequest(new store_request_t(top->core2dcache_addr, top->core2dcache_data, top->core2dcache_data_size));
+        if (top->core2dcache_data_we) {
+          if (store_buffer.AddStoreRequest(top->core2dcache_addr, top->core2dcache_data, top->core2dcache_data_size) == -1) {
+            reason = stop_reason_t::error;
+            break;
+          }
+        }
         // Execute load instructions -> first check store buffer then check memory
         else
           store_buffer.LoadData(top->core2dcache_addr, reinterpret_cast<char *>(&(top->dcache2core_data)));
@@ -100,47 +490,84 @@ int main(int argc, char **argv) {
 
     top->eval();
 
-    printf("[%ld] {dmem} c2d_addr=0x%x, c2d_we=%d, c2d_size=%d, d2c_v=%d, {imem} c2i_addr=0x%x, i2d_v=%d \n", 
-        contextp->time(), top->core2dcache_addr, top->core2dcache_data_we, top->core2dcache_data_size, (int) (top->dcache2core_data_valid), 
-        top->core2icache_addr, (int)(top->icache2core_data_valid));
-    printf("    {dmem} c2d_data=%ld, d2c_data=%ld\n", top->core2dcache_data, top->dcache2core_data); 
-    printf("{ctrl} clk=%d, rst=%d\n", top->clock, top->reset);
-    printf("{dmem/hex} c2d_data=");
-    for(int i = 0; i < 8; ++i) {
-      printf("%02x", (unsigned char)(reinterpret_cast<char *>(&(top->core2dcache_data))[i]));
-    }
-    printf("\n");
-    printf("{dmem/hex} d2c_data=");
-    for(int i = 0; i < 8; ++i) {
-      printf("%02x", (unsigned char)(reinterpret_cast<char *>(&(top->dcache2core_data))[i]));
-    }
-    printf("\n");
-    printf("{imem/hex} i2c_data=");
-    for(int i = 0; i < 16; ++i) {
-      printf("%02x", (unsigned char)(reinterpret_cast<char *>(top->icache2core_data)[i]));
+    if (SIM_LOG_ON(2, opts.verbosity)) {
+      printf("[%ld] {dmem} c2d_addr=0x%x, c2d_we=%d, c2d_size=%d, d2c_v=%d, {imem} c2i_addr=0x%x, i2d_v=%d \n", 
+          contextp->time(), top->core2dcache_addr, top->core2dcache_data_we, top->core2dcache_data_size, (int) (top->dcache2core_data_valid), 
+          top->core2icache_addr, (int)(top->icache2core_data_valid));
+      printf("    {dmem} c2d_data=%ld, d2c_data=%ld\n", top->core2dcache_data, top->dcache2core_data); 
+      printf("{ctrl} clk=%d, rst=%d\n", top->clock, top->reset);
+      printf("{dmem/hex} c2d_data=");
+      for(int i = 0; i < 8; ++i) {
+        printf("%02x", (unsigned char)(reinterpret_cast<char *>(&(top->core2dcache_data))[i]));
+      }
+      printf("\n");
+      printf("{dmem/hex} d2c_data=");
+      for(int i = 0; i < 8; ++i) {
+        printf("%02x", (unsigned char)(reinterpret_cast<char *>(&(top->dcache2core_data))[i]));
+      }
+      printf("\n");
+      printf("{imem/hex} i2c_data=");
+      for(int i = 0; i < 16; ++i) {
+        printf("%02x", (unsigned char)(reinterpret_cast<char *>(top->icache2core_data)[i]));
+      }
+      printf("\n");
     }
-    printf("\n");
 
-    if (i > SIM_TIME) {
-      break;
+    // tohost can only become non-zero and fromhost zero by a store of
+    // the program, so the front end server only has to read tohost after
+    // the cycles that wrote one of them.  The devices are ticked every
+    // time, as before, whether or not the program talks to them: this is
+    // how a syscall on the worker thread or a device that acts on its own
+    // gets its answer to fromhost
+    if (store_buffer.TakeWatchedWrite() || htif_poll) {
+      if (SIM_LOG_ON(2, opts.verbosity))
+        printf("[host move]\n");
+      sim.process_htio();
+      htif_poll = false;
+    } else {
+      sim.tick_devices();
     }
-
-    std::cout << "[host move]" << std::endl;
-
-    // front end server handle the command
-    sim.process_htio();
     i++; 
   }
 
+  // every stop ends here, a signal or a budget too
+  sim.finish_io();
+  console.flush();
+  char_console.flush();
+
   std::cout << std::endl << std::endl;
   std::cout << "===================================  [SIMULATION ENDS] ===============================" << std::endl;
   std::cout << "exit code: " << sim.exit_code() << std::endl;
+  std::cout << "stopped by: " << stop_reason_name(reason) << std::endl;
+
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+  unsigned long long cycles = budget.cycles, insts = budget.insts;
+  printf("simulated %llu cycles, %llu instructions (IPC %.3f) in %.2f s: %.0f cycles/s, %.0f instructions/s\n",
+         cycles, insts, cycles ? (double) insts / cycles : 0.0, seconds,
+         seconds > 0 ? cycles / seconds : 0.0, seconds > 0 ? insts / seconds : 0.0);
+
+  if (golden)
+    printf("co-simulation checked %llu instructions\n", golden->retired());
+  if (profile)
+    profile->print(stdout);
+
+  printf("fetched %llu lines, %llu were still in place\n", imem->fetch_count(), imem->elided_fetch_count());
+  printf("console: %llu bytes in %llu host writes, %llu bytes to stderr in %llu\n", console.bytes(),
+         console.host_writes(), char_console.bytes(), char_console.host_writes());
+
+  store_buffer.GetStats().Print(stdout);
+  if (!opts.stats_json.empty()) {
+    std::ofstream stats_file(opts.stats_json);
+    store_buffer.GetStats().WriteJson(stats_file);
+  }
 
-  printf("Final memory layout: \n");
-
-  memory->print_all();
+  if (!opts.dump_memory.empty()) {
+    memdump_write(*memory, opts.dump_memory + "_final.mdmp");
+    if (SIM_LOG_ON(1, opts.verbosity))
+      printf("Final memory layout: %s_final.mdmp\n", opts.dump_memory.c_str());
+  }
 
   sim.stop();
 
-  return 0;
+  return stop_exit_status(reason, sim.exit_code());
 }
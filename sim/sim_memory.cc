@@ -1,4 +1,6 @@
 #include "sim_memory.h"
+#include "memdump.h"
+#include "decode_cache.h"
 
 #include <unordered_map>
 #include <map>
@@ -7,19 +9,71 @@
 #include <cstdio>
 #include <memory>
 #include <cstring>
-#include <functional>
 #include <iostream>
+#include <algorithm>
+#include <vector>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 inline unsigned smaller(unsigned a, unsigned b) { return a < b ? a : b; }
 inline unsigned bigger(unsigned a, unsigned b) { return a > b ? a : b; }
 
+// open <imageFile> to be mapped at <addr>, the image has to fit below 4GiB
+static int open_image(const std::string &imageFile, unsigned addr, unsigned long long &size) {
+  int fd = open(imageFile.c_str(), O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) < 0) {
+    if (fd >= 0) close(fd);
+    throw std::runtime_error("cannot open image " + imageFile);
+  }
+  size = st.st_size;
+  if (addr + size > (1ull << 32)) {
+    close(fd);
+    throw std::runtime_error("image " + imageFile + " does not fit in the address space");
+  }
+  return fd;
+}
+
+/*
+ * A private mapping of a whole image file.  The pages can be written, the
+ * kernel copies them on the first write, and the file is never changed.
+ */
+struct mapped_image_t {
+  char *data = nullptr;
+  unsigned long long size = 0;
+
+  mapped_image_t(const std::string &imageFile, unsigned addr) {
+    int fd = open_image(imageFile, addr, size);
+    if (size) {
+      void *p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+      if (p != MAP_FAILED) data = static_cast<char *>(p);
+    }
+    close(fd);
+    if (size && !data)
+      throw std::runtime_error("cannot map image " + imageFile);
+  }
+
+  mapped_image_t(const mapped_image_t &) = delete;
+  mapped_image_t &operator=(const mapped_image_t &) = delete;
+
+  ~mapped_image_t() {
+    if (data) munmap(data, size);
+  }
+};
+
 class BucketMemory final: public IdeaMemory {
   private:
     static constexpr unsigned bucketBits = 10;
     static constexpr unsigned bucketSize = 1 << bucketBits;
-    static constexpr unsigned line_bytes = 32;
-    static constexpr unsigned byte_group = 4;
     std::unordered_map<unsigned, std::array<char, bucketSize>> buckets;
+    unsigned long long lookups = 0;
+
+    struct BucketSnapshot final: public MemorySnapshot {
+      std::unordered_map<unsigned, std::array<char, bucketSize>> buckets;
+    };
 
     unsigned which_bucket(unsigned addr) const { return addr >> bucketBits; }
     
@@ -29,35 +83,35 @@ class BucketMemory final: public IdeaMemory {
       return (bucket_pos << bucketBits) + bucket_addr;
     }
 
-    void print_non_zero_line(unsigned addr, char *data, unsigned st) {
-      bool zero = 1;
-      for (unsigned j = st; j < st + line_bytes; ++j) {
-        if (data[j]) zero = 0;
-      }
-      if (zero) return;
+    // copy <Size> bytes that lie in one bucket, the size is known at compile time
+    template <unsigned Size>
+    static void copy_fixed(char *dest, const char *src) { std::memcpy(dest, src, Size); }
 
-      std::printf("0x%08x     :  ", addr);
-      for (unsigned j = st; j < st + line_bytes; ++j) {
-        std::printf("%02x", (unsigned char) data[j]);
-        if ((j + 1) % byte_group == 0) std::printf(" ");
+    // copy <size> bytes that lie in one bucket, dispatch the common sizes to copy_fixed
+    static void copy_in_bucket(char *dest, const char *src, unsigned size) {
+      switch (size) {
+        case 1:  copy_fixed<1>(dest, src); break;
+        case 2:  copy_fixed<2>(dest, src); break;
+        case 4:  copy_fixed<4>(dest, src); break;
+        case 8:  copy_fixed<8>(dest, src); break;
+        case 16: copy_fixed<16>(dest, src); break;
+        default: std::memcpy(dest, src, size);
       }
-      std::printf("\n");
     }
 
-    void print_non_zero_lines(unsigned bucket_pos) {
-      char *data = buckets[bucket_pos].data();
-      for (unsigned i = 0; i < bucketSize; i += line_bytes) {
-        print_non_zero_line(make_addr(bucket_pos, i), data, i);
-      }
+    bool in_one_bucket(unsigned addr, unsigned size) const {
+      return size && which_bucket(addr) == which_bucket(addr + size - 1);
     }
 
     // walk_through a block of memory <addr, size>, f will have access to them
-    void walk_through(unsigned addr, unsigned size, std::function<void (char *, unsigned)> f) {
+    template <typename F>
+    void walk_through(unsigned addr, unsigned size, F &&f) {
       unsigned bucket_pos = which_bucket(addr), bucket_st = pos_in_bucket(addr);
       while (size) {
         unsigned p_sz = smaller(bucketSize - bucket_st, size);
         //std::cout << "which bucket: " << bucket_pos << ", pos in bucket: " << bucket_st << " p_sz: " << p_sz << std::endl;
         char *bucketData = buckets[bucket_pos].data(); // value-initialized array;
+        ++lookups;
         f(bucketData + bucket_st, p_sz);
 
         size -= p_sz;
@@ -68,14 +122,11 @@ class BucketMemory final: public IdeaMemory {
     }
 
   public:
-    void load_image_to(const std::string &imageFile, unsigned addr) override {
-      std::ifstream imageBin{imageFile, std::ios::binary};
-
-      imageBin.seekg(0, std::ios::end);
-      auto imageSize = imageBin.tellg();
-      imageBin.seekg(0, std::ios::beg);
-
-      walk_through(addr, imageSize, [&] (char *st, unsigned sz){imageBin.read(st, sz);});
+    // buckets cannot alias the file, the image is copied out of a mapping
+    void do_load_image_to(const std::string &imageFile, unsigned addr) override {
+      mapped_image_t image(imageFile, addr);
+      const char *src = image.data;
+      walk_through(addr, image.size, [&] (char *st, unsigned sz){ std::memcpy(st, src, sz); src += sz; });
     }
 
     void dump_data(const std::string &dumpFile, unsigned addr, unsigned size) override {
@@ -85,47 +136,564 @@ class BucketMemory final: public IdeaMemory {
     }
 
     unsigned read_bytes(char *dest, unsigned addr, unsigned size) override {
+      if (in_one_bucket(addr, size)) {
+        ++lookups;
+        copy_in_bucket(dest, buckets[which_bucket(addr)].data() + pos_in_bucket(addr), size);
+        return size;
+      }
       walk_through(addr, size, [&](char *st, unsigned sz){ std::memcpy(dest, st, sz); dest += sz; });
       return size;
     } 
 
-    unsigned write_bytes(const char *src, unsigned size, unsigned addr) override {
+    unsigned do_write_bytes(const char *src, unsigned size, unsigned addr) override {
+      if (in_one_bucket(addr, size)) {
+        ++lookups;
+        copy_in_bucket(buckets[which_bucket(addr)].data() + pos_in_bucket(addr), src, size);
+        return size;
+      }
       walk_through(addr, size, [&](char *st, unsigned sz){ std::memcpy(st, src, sz); src += sz; });
       return size;
     }
 
+    char *do_host_ptr(unsigned addr, unsigned size, mem_access_t kind) override {
+      if (!in_one_bucket(addr, size)) return nullptr;
+      ++lookups;
+      return buckets[which_bucket(addr)].data() + pos_in_bucket(addr);
+    }
+
     void print_bytes_up(unsigned addr, unsigned size) const override { }
 
     void print_bytes_down(unsigned addr, unsigned size) const override { }
 
-    // print all values that is not 0
-    void print_all() override {
-      printf("The memory holds: 1        2        3        4        5        6        7        8\n");
-      printf("----------------------------------------------------------------------------------\n");
-      std::map<unsigned, std::array<char, bucketSize>> btmp(buckets.begin(), buckets.end());
-      for (auto &b: btmp) {
-        print_non_zero_lines(b.first);
+    unsigned long long lookup_count() const override { return lookups; }
+
+    void for_each_block(const std::function<void (unsigned, const char *, unsigned)> &f) override {
+      std::vector<unsigned> order;
+      order.reserve(buckets.size());
+      for (auto &b: buckets) order.push_back(b.first);
+      std::sort(order.begin(), order.end());
+      for (auto pos: order) {
+        f(make_addr(pos, 0), buckets[pos].data(), bucketSize);
       }
     }
 
+    void do_clear() override {
+      buckets.clear();
+    }
+
+    // buckets are not shared, the snapshot is a full copy
+    std::shared_ptr<const MemorySnapshot> take_snapshot() override {
+      auto snap = std::make_shared<BucketSnapshot>();
+      snap->buckets = buckets;
+      return snap;
+    }
+
+    void do_restore_snapshot(const MemorySnapshot &snap) override {
+      buckets = dynamic_cast<const BucketSnapshot &>(snap).buckets;
+    }
+
     ~BucketMemory() override {}
 };
 
+// print the non-zero 32-byte lines, one group of 4 bytes after another
+void IdeaMemory::print_all() {
+  static constexpr unsigned line_bytes = 32;
+  static constexpr unsigned byte_group = 4;
+  printf("The memory holds: 1        2        3        4        5        6        7        8\n");
+  printf("----------------------------------------------------------------------------------\n");
+  for_each_block([&](unsigned addr, const char *data, unsigned size) {
+    for (unsigned i = 0; i + line_bytes <= size; i += line_bytes) {
+      const char *line = data + i;
+      if (std::all_of(line, line + line_bytes, [](char c) { return c == 0; })) continue;
+      std::printf("0x%08x     :  ", addr + i);
+      for (unsigned j = 0; j < line_bytes; ++j) {
+        std::printf("%02x", (unsigned char) line[j]);
+        if ((j + 1) % byte_group == 0) std::printf(" ");
+      }
+      std::printf("\n");
+    }
+  });
+}
+
+// every backend holds an aligned 1KiB block in one piece
+static constexpr unsigned host_block_bytes = 1024;
+
+// the string is scanned in place, block by block
+unsigned IdeaMemory::read_string(char *dest, unsigned addr, unsigned max_size) {
+  unsigned len = 0;
+  while (len < max_size) {
+    unsigned n = smaller(host_block_bytes - (addr + len) % host_block_bytes, max_size - len);
+    const char *st = host_ptr(addr + len, n, mem_access_t::load);
+    if (!st) {
+      read_bytes(dest + len, addr + len, n);
+      st = dest + len;
+    }
+    const char *nul = static_cast<const char *>(std::memchr(st, 0, n));
+    unsigned m = nul ? nul - st : n;
+    if (st != dest + len) std::memcpy(dest + len, st, nul ? m + 1 : m);
+    len += m;
+    if (nul) return len;
+  }
+  return max_size;
+}
+
+// the blocks that follow each other in the host are merged, so a flat
+// memory gives one range and a paged one a range per page
+void IdeaMemory::host_iovecs(unsigned addr, unsigned size, mem_access_t kind, std::vector<iovec> &iov) {
+  while (size) {
+    unsigned n = smaller(host_block_bytes - addr % host_block_bytes, size);
+    char *st = host_ptr(addr, n, kind);
+    if (!iov.empty() && static_cast<char *>(iov.back().iov_base) + iov.back().iov_len == st)
+      iov.back().iov_len += n;
+    else
+      iov.push_back({st, n});
+    addr += n;
+    size -= n;
+  }
+}
+
+void IdeaMemory::save(std::ostream &os) {
+  memdump_write(*this, os);
+}
+
+void IdeaMemory::load(std::istream &is) {
+  memdump_load(is, *this);
+}
+
 std::unique_ptr<IdeaMemory> make_BucketMemory() {
   return std::make_unique<BucketMemory>();
 }
 
+/*
+ * The whole 4GiB guest space is reserved once with MAP_NORESERVE, the kernel
+ * hands out zero pages lazily, so an access is just <base + addr>.
+ *
+ * Written pages are recorded in <touched> so that print_all does not have to
+ * scan the whole space.
+ */
+class FlatMemory final: public IdeaMemory {
+  private:
+    static constexpr unsigned long long spaceSize = 1ull << 32;
+    static constexpr unsigned pageBits = 12;
+    static constexpr unsigned pageSize = 1 << pageBits;
+    char *base;
+    std::vector<bool> touched;
+    // ranges mapped from image files, <addr, size>
+    std::vector<std::pair<unsigned, unsigned long long>> file_maps;
+
+    struct FlatSnapshot final: public MemorySnapshot {
+      std::vector<bool> touched;
+      std::map<unsigned, std::array<char, pageSize>> pages;
+    };
+
+    static unsigned pos_in_page(unsigned addr) { return addr & (pageSize - 1); }
+
+    // put anonymous memory back over the image files, MADV_DONTNEED would
+    // bring back the file content instead of zeros
+    void unmap_images() {
+      for (auto &m : file_maps) {
+        mmap(base + m.first, m.second, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0);
+      }
+      file_maps.clear();
+    }
+
+    void touch(unsigned addr, unsigned size) {
+      if (!size) return;
+      for (unsigned long long p = addr >> pageBits; p <= (addr + size - 1ull) >> pageBits; ++p) {
+        touched[p % touched.size()] = true;
+      }
+    }
+
+    // the access may wrap around the top of the address space, as the BucketMemory
+    template <typename F>
+    void walk_through(unsigned addr, unsigned size, F &&f) {
+      if (addr + (unsigned long long) size <= spaceSize) {
+        f(base + addr, size);
+        return;
+      }
+      unsigned p_sz = spaceSize - addr;
+      f(base + addr, p_sz);
+      f(base, size - p_sz);
+    }
+
+  public:
+    FlatMemory(): touched(spaceSize >> pageBits, false) {
+      void *p = mmap(nullptr, spaceSize, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+      if (p == MAP_FAILED)
+        throw std::runtime_error("FlatMemory: cannot reserve the 4GiB guest address space");
+      base = static_cast<char *>(p);
+    }
+
+    // the whole pages of an image at a page aligned <addr> are mapped over
+    // the reservation, the rest is copied
+    void do_load_image_to(const std::string &imageFile, unsigned addr) override {
+      unsigned long long size;
+      int fd = open_image(imageFile, addr, size);
+      unsigned long long mapped = pos_in_page(addr) ? 0 : size & ~(pageSize - 1ull);
+      if (mapped) {
+        void *p = mmap(base + addr, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0);
+        if (p == MAP_FAILED) mapped = 0;
+        else file_maps.push_back({addr, mapped});
+      }
+      touch(addr, mapped);
+
+      unsigned long long off = mapped;
+      while (off < size) {
+        ssize_t n = pread(fd, base + addr + off, size - off, off);
+        if (n <= 0) break;
+        touch(addr + off, n);
+        off += n;
+      }
+      close(fd);
+      if (off < size)
+        throw std::runtime_error("cannot read image " + imageFile);
+    }
+
+    void dump_data(const std::string &dumpFile, unsigned addr, unsigned size) override {
+      std::ofstream dumpBin{dumpFile, std::ios::binary};
+
+      walk_through(addr, size, [&] (char *st, unsigned sz){dumpBin.write(st, sz);});
+    }
+
+    unsigned read_bytes(char *dest, unsigned addr, unsigned size) override {
+      walk_through(addr, size, [&](char *st, unsigned sz){ std::memcpy(dest, st, sz); dest += sz; });
+      return size;
+    }
+
+    unsigned do_write_bytes(const char *src, unsigned size, unsigned addr) override {
+      touch(addr, size);
+      walk_through(addr, size, [&](char *st, unsigned sz){ std::memcpy(st, src, sz); src += sz; });
+      return size;
+    }
+
+    char *do_host_ptr(unsigned addr, unsigned size, mem_access_t kind) override {
+      if (addr + (unsigned long long) size > spaceSize) return nullptr;
+      if (kind == mem_access_t::store) touch(addr, size);
+      return base + addr;
+    }
+
+    void print_bytes_up(unsigned addr, unsigned size) const override { }
+
+    void print_bytes_down(unsigned addr, unsigned size) const override { }
+
+    void for_each_block(const std::function<void (unsigned, const char *, unsigned)> &f) override {
+      for (unsigned p = 0; p < touched.size(); ++p) {
+        if (touched[p]) f(p << pageBits, base + ((unsigned long long) p << pageBits), pageSize);
+      }
+    }
+
+    void do_clear() override {
+      unmap_images();
+      for (unsigned p = 0; p < touched.size(); ++p) {
+        if (touched[p]) madvise(base + ((unsigned long long) p << pageBits), pageSize, MADV_DONTNEED);
+      }
+      touched.assign(touched.size(), false);
+    }
+
+    // the touched pages are copied out of the reservation
+    std::shared_ptr<const MemorySnapshot> take_snapshot() override {
+      auto snap = std::make_shared<FlatSnapshot>();
+      snap->touched = touched;
+      for (unsigned p = 0; p < touched.size(); ++p) {
+        if (!touched[p]) continue;
+        std::memcpy(snap->pages[p].data(), base + ((unsigned long long) p << pageBits), pageSize);
+      }
+      return snap;
+    }
+
+    void do_restore_snapshot(const MemorySnapshot &snap) override {
+      auto &flat = dynamic_cast<const FlatSnapshot &>(snap);
+      unmap_images();
+      for (unsigned p = 0; p < touched.size(); ++p) {
+        if (touched[p] && !flat.touched[p])
+          madvise(base + ((unsigned long long) p << pageBits), pageSize, MADV_DONTNEED);
+      }
+      for (auto &page : flat.pages) {
+        std::memcpy(base + ((unsigned long long) page.first << pageBits), page.second.data(), pageSize);
+      }
+      touched = flat.touched;
+    }
+
+    ~FlatMemory() override {
+      munmap(base, spaceSize);
+    }
+};
+
+std::unique_ptr<IdeaMemory> make_FlatMemory() {
+  return std::make_unique<FlatMemory>();
+}
+
+/*
+ * A two level page table of 4KiB pages: addr[31:22] indexes the directory,
+ * addr[21:12] the table, pages are allocated on first write.  Reads of a
+ * page that was never written are served from a shared zero page.
+ *
+ * The last pages used by the instruction stream and by data accesses are
+ * cached, so sequential fetches almost never walk the table.
+ *
+ * Tables and pages are reference counted.  A snapshot just copies the
+ * directory; a table or page that is shared with a snapshot is copied on
+ * its first write.
+ */
+class PagedMemory final: public IdeaMemory {
+  private:
+    static constexpr unsigned pageBits = 12;
+    static constexpr unsigned pageSize = 1 << pageBits;
+    static constexpr unsigned tableBits = 10;
+    static constexpr unsigned tableSize = 1 << tableBits;
+    static constexpr unsigned dataWays = 4;
+
+    using page_t = std::array<char, pageSize>;
+    using table_t = std::array<std::shared_ptr<page_t>, tableSize>;
+    using directory_t = std::array<std::shared_ptr<table_t>, tableSize>;
+
+    struct PagedSnapshot final: public MemorySnapshot {
+      directory_t directory;
+    };
+
+    struct page_cache_t {
+      unsigned vpn = ~0u;     // never matches a valid page number
+      char *data = nullptr;
+      bool writable = false;
+    };
+
+    directory_t directory;
+    page_cache_t fetch_cache;
+    std::array<page_cache_t, dataWays> data_cache;
+    unsigned long long lookups = 0;
+
+    static const page_t zero_page;
+
+    static unsigned vpn_of(unsigned addr) { return addr >> pageBits; }
+
+    static unsigned pos_in_page(unsigned addr) { return addr & (pageSize - 1); }
+
+    page_cache_t &data_way(unsigned vpn) { return data_cache[vpn % dataWays]; }
+
+    // the table of <vpn>, allocated or copied so that it can be changed
+    table_t &writable_table(unsigned vpn) {
+      auto &table = directory[vpn >> tableBits];
+      if (!table) {
+        table = std::make_shared<table_t>();
+      } else if (table.use_count() > 1) {
+        table = std::make_shared<table_t>(*table);
+      }
+      return *table;
+    }
+
+    // search the page table, allocate the page or break the sharing if <write>
+    char *walk(unsigned vpn, bool write, bool &writable) {
+      ++lookups;
+      writable = false;
+      auto &table = directory[vpn >> tableBits];
+      if (!table && !write) return const_cast<char *>(zero_page.data());
+      auto &page = (write ? writable_table(vpn) : *table)[vpn & (tableSize - 1)];
+      if (!page) {
+        if (!write) return const_cast<char *>(zero_page.data());
+        page = std::make_shared<page_t>(); // value-initialized array
+      } else if (write && page.use_count() > 1) {
+        page = std::make_shared<page_t>(*page);
+      }
+      writable = table.use_count() == 1 && page.use_count() == 1;
+      return page->data();
+    }
+
+    char *translate(page_cache_t &cache, unsigned vpn, bool write) {
+      if (cache.vpn == vpn && (cache.writable || !write))
+        return cache.data;
+      bool writable;
+      char *data = walk(vpn, write, writable);
+      if (write) drop_stale(vpn, data);
+      cache.vpn = vpn;
+      cache.data = data;
+      cache.writable = writable;
+      return data;
+    }
+
+    // a newly allocated or copied page hides the old one in the other cache
+    void drop_stale(unsigned vpn, const char *data) {
+      if (fetch_cache.vpn == vpn && fetch_cache.data != data) fetch_cache.vpn = ~0u;
+      auto &way = data_way(vpn);
+      if (way.vpn == vpn && way.data != data) way.vpn = ~0u;
+    }
+
+    void flush_caches(bool keep_readable) {
+      fetch_cache.writable = false;
+      if (!keep_readable) fetch_cache.vpn = ~0u;
+      for (auto &way : data_cache) {
+        way.writable = false;
+        if (!keep_readable) way.vpn = ~0u;
+      }
+    }
+
+    // walk_through a block of memory <addr, size>, f will have access to them
+    template <typename F>
+    void walk_through(unsigned addr, unsigned size, bool fetch, bool write, F &&f) {
+      while (size) {
+        unsigned vpn = vpn_of(addr), page_st = pos_in_page(addr);
+        unsigned p_sz = smaller(pageSize - page_st, size);
+        page_cache_t &cache = fetch ? fetch_cache : data_way(vpn);
+        char *pageData = translate(cache, vpn, write);
+        f(pageData + page_st, p_sz);
+
+        size -= p_sz;
+        addr += p_sz;
+      }
+    }
+
+  public:
+    // the whole guest pages of the image point into the mapping, the
+    // partial ones at both ends are copied
+    void do_load_image_to(const std::string &imageFile, unsigned addr) override {
+      auto image = std::make_shared<mapped_image_t>(imageFile, addr);
+      unsigned long long head = smaller(image->size, (pageSize - pos_in_page(addr)) % pageSize);
+      write_bytes(image->data, head, addr);
+
+      unsigned long long off = head;
+      for (; off + pageSize <= image->size; off += pageSize) {
+        unsigned vpn = vpn_of(addr + off);
+        // shares the ownership of the mapping, copied on the first write
+        // like a page shared with a snapshot
+        writable_table(vpn)[vpn & (tableSize - 1)] =
+            std::shared_ptr<page_t>(image, reinterpret_cast<page_t *>(image->data + off));
+      }
+      write_bytes(image->data + off, image->size - off, addr + off);
+      flush_caches(false);
+    }
+
+    void dump_data(const std::string &dumpFile, unsigned addr, unsigned size) override {
+      std::ofstream dumpBin{dumpFile, std::ios::binary};
+
+      walk_through(addr, size, false, false, [&] (char *st, unsigned sz){dumpBin.write(st, sz);});
+    }
+
+    unsigned read_bytes(char *dest, unsigned addr, unsigned size) override {
+      // fast path: the access stays inside the cached page
+      page_cache_t &cache = data_way(vpn_of(addr));
+      if (cache.vpn == vpn_of(addr) && vpn_of(addr + size - 1) == cache.vpn) {
+        std::memcpy(dest, cache.data + pos_in_page(addr), size);
+        return size;
+      }
+      walk_through(addr, size, false, false, [&](char *st, unsigned sz){ std::memcpy(dest, st, sz); dest += sz; });
+      return size;
+    }
+
+    unsigned fetch_bytes(char *dest, unsigned addr, unsigned size) override {
+      if (fetch_cache.vpn == vpn_of(addr) && vpn_of(addr + size - 1) == fetch_cache.vpn) {
+        std::memcpy(dest, fetch_cache.data + pos_in_page(addr), size);
+        return size;
+      }
+      walk_through(addr, size, true, false, [&](char *st, unsigned sz){ std::memcpy(dest, st, sz); dest += sz; });
+      return size;
+    }
+
+    unsigned do_write_bytes(const char *src, unsigned size, unsigned addr) override {
+      walk_through(addr, size, false, true, [&](char *st, unsigned sz){ std::memcpy(st, src, sz); src += sz; });
+      return size;
+    }
+
+    char *do_host_ptr(unsigned addr, unsigned size, mem_access_t kind) override {
+      unsigned vpn = vpn_of(addr);
+      if (!size || vpn_of(addr + size - 1) != vpn) return nullptr;
+      page_cache_t &cache = kind == mem_access_t::fetch ? fetch_cache : data_way(vpn);
+      return translate(cache, vpn, kind == mem_access_t::store) + pos_in_page(addr);
+    }
+
+    void print_bytes_up(unsigned addr, unsigned size) const override { }
+
+    void print_bytes_down(unsigned addr, unsigned size) const override { }
+
+    unsigned long long lookup_count() const override { return lookups; }
+
+    void for_each_block(const std::function<void (unsigned, const char *, unsigned)> &f) override {
+      for (unsigned d = 0; d < tableSize; ++d) {
+        if (!directory[d]) continue;
+        for (unsigned t = 0; t < tableSize; ++t) {
+          auto &page = (*directory[d])[t];
+          if (page) f(((d << tableBits) + t) << pageBits, page->data(), pageSize);
+        }
+      }
+    }
+
+    void do_clear() override {
+      directory = directory_t{};
+      flush_caches(false);
+    }
+
+    std::shared_ptr<const MemorySnapshot> take_snapshot() override {
+      auto snap = std::make_shared<PagedSnapshot>();
+      snap->directory = directory;
+      // the cached pages are shared with the snapshot now
+      flush_caches(true);
+      return snap;
+    }
+
+    void do_restore_snapshot(const MemorySnapshot &snap) override {
+      directory = dynamic_cast<const PagedSnapshot &>(snap).directory;
+      flush_caches(false);
+    }
+
+    ~PagedMemory() override {}
+};
+
+const PagedMemory::page_t PagedMemory::zero_page{};
+
+std::unique_ptr<IdeaMemory> make_PagedMemory() {
+  return std::make_unique<PagedMemory>();
+}
+
+std::unique_ptr<IdeaMemory> make_IdeaMemory(const std::string &kind) {
+  if (kind.empty() || kind == "paged")
+    return make_PagedMemory();
+  if (kind == "bucket")
+    return make_BucketMemory();
+  if (kind == "flat")
+    return make_FlatMemory();
+  throw std::invalid_argument("unknown memory backend: " + kind);
+}
+
+void load_image_spec(IdeaMemory &mem, const std::string &spec) {
+  auto at = spec.rfind('@');
+  if (at == std::string::npos) {
+    mem.load_image_to(spec, 0);
+    return;
+  }
+  unsigned long long addr = std::stoull(spec.substr(at + 1), nullptr, 0);
+  if (addr >> 32)
+    throw std::invalid_argument("image address out of range: " + spec);
+  mem.load_image_to(spec.substr(0, at), addr);
+}
+
 bool IMem::read_transction(unsigned addr, char *dest) {
-  this->mem->read_bytes(dest, addr, 16);
+  ++fetches;
+  unsigned long long epoch = mem->write_epoch();
+  if (elide && dest == last_dest && addr == last_addr && epoch == last_epoch) {
+    ++elided;
+    return true;
+  }
+  // one host_ptr call and an inlined 16-byte copy when the line is in one page
+  this->mem->fetch_block<16>(dest, addr);
+  last_addr = addr;
+  last_dest = dest;
+  last_epoch = epoch;
   return true;
 }
 
 bool DMem::write_transcation(unsigned addr, const char *src, unsigned char size) {
-  this->mem->write_bytes(src, size, addr);
+  if (decode_cache) decode_cache->invalidate(addr, size);
+  switch (size) {
+    case 1: this->mem->write_block<1>(src, addr); break;
+    case 2: this->mem->write_block<2>(src, addr); break;
+    case 4: this->mem->write_block<4>(src, addr); break;
+    case 8: this->mem->write_block<8>(src, addr); break;
+    default: this->mem->write_bytes(src, size, addr);
+  }
   return true;
 }
 
 bool DMem::read_transction(unsigned addr, char *dest) {
-  this->mem->read_bytes(dest, addr, 8);
+  this->mem->read_block<8>(dest, addr);
   return true;
 }
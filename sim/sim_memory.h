@@ -3,8 +3,21 @@
 
 #include <string>
 #include <memory>
+#include <cstring>
+#include <functional>
+#include <iosfwd>
+#include <vector>
+#include <sys/uio.h>
 
-static unsigned char data_size_map[4] = {1, 2, 4, 8};
+// the bytes of an access of size code 0-3
+static constexpr unsigned char data_size_map[4] = {1, 2, 4, 8};
+
+enum class mem_access_t { fetch, load, store };
+
+// the memory content at some point, only meaningful to the memory that took it
+struct MemorySnapshot {
+  virtual ~MemorySnapshot() {};
+};
 
 /*
  * This memory expect to provide 4Gb address space
@@ -13,8 +26,12 @@ static unsigned char data_size_map[4] = {1, 2, 4, 8};
  */
 
 struct IdeaMemory {
-  // load <imageFile> to <addr>.
-  virtual void load_image_to(const std::string &imageFile, unsigned addr) = 0;
+  // load <imageFile> to <addr>, the file is mapped, not read, where the
+  // backend allows it.  It must not change while the memory uses it.
+  void load_image_to(const std::string &imageFile, unsigned addr) {
+    ++epoch;
+    do_load_image_to(imageFile, addr);
+  }
 
   // store [addr, addr + size - 1] data to <dumpFile>
   virtual void dump_data(const std::string &dumpFile, unsigned addr, unsigned size) = 0;
@@ -22,8 +39,24 @@ struct IdeaMemory {
   // read <size> bytes from <addr> to <dest>, return the # of words
   virtual unsigned read_bytes(char *dest, unsigned addr, unsigned size) = 0;
 
+  // copy the NUL terminated string at <addr> to <dest>, at most <max_size>
+  // bytes with the NUL.  Return its length without the NUL, or <max_size>
+  // when the range holds no NUL (then <dest> is not terminated)
+  unsigned read_string(char *dest, unsigned addr, unsigned max_size);
+
+  // append the host ranges that hold [addr, addr + size - 1] to <iov>, in
+  // address order, for readv / writev straight into the guest memory.  A
+  // store allocates the storage and counts as a write.
+  void host_iovecs(unsigned addr, unsigned size, mem_access_t kind, std::vector<iovec> &iov);
+
+  // same as read_bytes, but for the instruction stream
+  virtual unsigned fetch_bytes(char *dest, unsigned addr, unsigned size) { return read_bytes(dest, addr, size); }
+
   // write <size> bytes from <src> to <addr>
-  virtual unsigned write_bytes(const char *src, unsigned size, unsigned addr) = 0;
+  unsigned write_bytes(const char *src, unsigned size, unsigned addr) {
+    ++epoch;
+    return do_write_bytes(src, size, addr);
+  }
 
   // print <size> bytes from <addr> to <addr> + <size>
   virtual void print_bytes_up(unsigned addr, unsigned size) const = 0;
@@ -32,9 +65,88 @@ struct IdeaMemory {
   virtual void print_bytes_down(unsigned addr, unsigned size) const = 0;
 
   // print all values that is not 0
-  virtual void print_all() = 0;
+  void print_all();
+
+  // # of times the backing storage had to be searched for an address
+  virtual unsigned long long lookup_count() const { return 0; }
+
+  // changes with every write, load, clear or restore: a copy of some of
+  // the content stays valid as long as the epoch does not change
+  unsigned long long write_epoch() const { return epoch; }
+
+  // host address of [addr, addr + size - 1] if it is contiguous in the
+  // backing storage, otherwise nullptr.  A store may allocate the storage.
+  char *host_ptr(unsigned addr, unsigned size, mem_access_t kind) {
+    if (kind == mem_access_t::store) ++epoch;
+    return do_host_ptr(addr, size, kind);
+  }
+
+  // fixed size accesses: one host_ptr call and a memcpy the compiler can
+  // inline, the generic path is only taken when the block is split
+  template <unsigned Size>
+  void read_block(char *dest, unsigned addr) {
+    if (const char *st = host_ptr(addr, Size, mem_access_t::load)) std::memcpy(dest, st, Size);
+    else read_bytes(dest, addr, Size);
+  }
+
+  template <unsigned Size>
+  void fetch_block(char *dest, unsigned addr) {
+    if (const char *st = host_ptr(addr, Size, mem_access_t::fetch)) std::memcpy(dest, st, Size);
+    else fetch_bytes(dest, addr, Size);
+  }
+
+  template <unsigned Size>
+  void write_block(const char *src, unsigned addr) {
+    if (char *st = host_ptr(addr, Size, mem_access_t::store)) std::memcpy(st, src, Size);
+    else write_bytes(src, Size, addr);
+  }
+
+  // call <f> on every block of storage that was ever written, in address order
+  virtual void for_each_block(const std::function<void (unsigned addr, const char *data, unsigned size)> &f) = 0;
+
+  // forget all the content, every location reads 0 again
+  void clear() {
+    ++epoch;
+    do_clear();
+  }
+
+  // write the content to <os> as a memdump, load() replaces the content with it
+  void save(std::ostream &os);
+  void load(std::istream &is);
+
+  // save the whole memory, it can be restored any number of times
+  virtual std::shared_ptr<const MemorySnapshot> take_snapshot() = 0;
+
+  // bring the memory back to <snap>, which must come from take_snapshot of this memory
+  void restore_snapshot(const MemorySnapshot &snap) {
+    ++epoch;
+    do_restore_snapshot(snap);
+  }
+
+  template <typename T>
+  T read(unsigned addr) {
+    T val;
+    read_block<sizeof(T)>(reinterpret_cast<char *>(&val), addr);
+    return val;
+  }
+
+  template <typename T>
+  void write(unsigned addr, const T &val) {
+    write_block<sizeof(T)>(reinterpret_cast<const char *>(&val), addr);
+  }
 
   virtual ~IdeaMemory() {};
+
+  protected:
+    // the backends, the calls above bump the epoch before they get here
+    virtual void do_load_image_to(const std::string &imageFile, unsigned addr) = 0;
+    virtual unsigned do_write_bytes(const char *src, unsigned size, unsigned addr) = 0;
+    virtual char *do_host_ptr(unsigned addr, unsigned size, mem_access_t kind) = 0;
+    virtual void do_clear() = 0;
+    virtual void do_restore_snapshot(const MemorySnapshot &snap) = 0;
+
+  private:
+    unsigned long long epoch = 0;
 };
 
 
@@ -43,25 +155,61 @@ class BucketMemory;
 
 std::unique_ptr<IdeaMemory> make_BucketMemory(); 
 
+class FlatMemory;
+
+std::unique_ptr<IdeaMemory> make_FlatMemory();
+
+class PagedMemory;
+
+std::unique_ptr<IdeaMemory> make_PagedMemory();
+
+// select a memory by name: "paged" (default), "bucket" or "flat"
+std::unique_ptr<IdeaMemory> make_IdeaMemory(const std::string &kind);
+
+// load an image given as "<file>@<addr>", or "<file>" to load it at 0
+void load_image_spec(IdeaMemory &mem, const std::string &spec);
+
 // currently an ideal Memory
 class IMem {
 
   private:
     IdeaMemory *mem;
+    // the last line fetched, while the frontend stalls it is fetched again
+    // into the same buffer, which still holds it unless memory was written.
+    // So <dest> must not be written by anything else.
+    unsigned last_addr = 0;
+    char *last_dest = nullptr;
+    unsigned long long last_epoch = 0;
+    unsigned long long fetches = 0;
+    unsigned long long elided = 0;
+    bool elide = true;
   public:
     IMem(IdeaMemory *mem): mem(mem) {}
 
+    // with <on> false every fetch goes to the memory, e.g. to measure it
+    void set_elision(bool on) { elide = on; }
+
     // read 4 words, 16 bytes from the IMem
     bool read_transction(unsigned addr, char *dest);
 
+    unsigned long long fetch_count() const { return fetches; }
+
+    // # of fetches that found the line already in <dest>
+    unsigned long long elided_fetch_count() const { return elided; }
 };
 
+class decode_cache_t;
+
 class DMem {
   private:
     IdeaMemory *mem;
+    decode_cache_t *decode_cache = nullptr;
   public:
     DMem(IdeaMemory *mem): mem(mem) {}
 
+    // drop the decoded instructions the writes overwrite
+    void set_decode_cache(decode_cache_t *cache) { decode_cache = cache; }
+
     // write <size> bytes to memory
     bool write_transcation(unsigned addr, const char *src, unsigned char size);
 
@@ -2,90 +2,267 @@
 #include <string.h>
 
 #include "store_buffer.h"
+#include "checkpoint.h"
+#include "sim_log.h"
 
-void StoreBuffer::AddStoreRequest(store_request_t* req) {
-  printf("[Store Buffer] incomming store..... addr=0x%x, data=0x%llx\n", req->addr, req->data);
-  buffer.push_back(req);
+#include <ostream>
+#include <stdexcept>
+
+void StoreBuffer::IndexStore(unsigned slot, bool insert) {
+  const store_request_t &req = ring[slot];
+  slot_mask_t bit = 1ull << slot;
+  unsigned first = Bucket(req.addr), last = Bucket(req.addr + data_size_map[req.size] - 1);
+  if (insert) {
+    word_index[first] |= bit;
+    word_index[last] |= bit;
+  } else {
+    word_index[first] &= ~bit;
+    word_index[last] &= ~bit;
+  }
+}
+
+int StoreBuffer::AddStoreRequest(unsigned int addr, unsigned long long data, unsigned char size) {
+  if (SIM_MAX_LOG_LEVEL >= 2 && logging)
+    printf("[Store Buffer] incomming store..... addr=0x%x, data=0x%llx\n", addr, data);
+  if (count == kCapacity) {
+    fprintf(stderr, "[Store Buffer] Error: more than %u pending stores\n", kCapacity);
+    return -1;
+  }
+  // an older store whose bytes are all written again can no longer forward
+  // anything, it leaves the index and stays in the ring until it commits
+  unsigned bytes = data_size_map[size];
+  slot_mask_t older = word_index[Bucket(addr)] | word_index[Bucket(addr + bytes - 1)];
+  while (older) {
+    unsigned slot = __builtin_ctzll(older);
+    older &= older - 1;
+    const store_request_t &req = ring[slot];
+    if (req.addr - addr <= bytes - data_size_map[req.size] && data_size_map[req.size] <= bytes)
+      IndexStore(slot, false);
+  }
+
+  stats.stores++;
+  tail = Slot(kCapacity - 1);
+  ring[tail] = store_request_t(addr, data, size);
+  IndexStore(tail, true);
+  count++;
+  return 0;
 }
 
 int StoreBuffer::CommitStoreRequest(unsigned int num_commit) {
   unsigned char data_size;
-  store_request_t* req;
+  int ret = 0;
 
-  if (num_commit > buffer.size()) {
-    fprintf(stderr, "[Store Buffer] Error: #commit=%d > store buffer size=%ld\n", num_commit, buffer.size());
-    FlushStoreBuffer();
-    return -1;
+  stats.cycles++;
+  stats.occupancy[count]++;
+  stats.commit_bursts[num_commit < kCommitWidth ? num_commit : kCommitWidth]++;
+
+  if (num_commit > count) {
+    fprintf(stderr, "[Store Buffer] Error: #commit=%d > store buffer size=%u\n", num_commit, count);
+    Clear();
+    return -2;
   }
 
   for (unsigned int i = 0; i < num_commit; i++) {
-    req = buffer.front();
-    data_size = data_size_map[req->size];
-    
-    if (req->addr == 0xFFFFFFFC) {
+    unsigned oldest = Slot(count - 1);
+    store_request_t &req = ring[oldest];
+    data_size = data_size_map[req.size];
+
+    if (req.addr == 0xFFFFFFFC) {
     // When we write to [0xFFFFFFFC], halt the simulation
-      FlushStoreBuffer();
+      Clear();
       return -1;
-    } else if (req->addr == 0xFFFFFFF8) {
-    // When we write a character to [0xFFFFFFF8], print it to stderr (only 1 character)
-      fprintf(stderr, "%c", *(reinterpret_cast<char *>(&(req->data))));
+    } else if (req.addr == 0xFFFFFFF8) {
+    // When we write a character to [0xFFFFFFF8], print it to the console (only 1 character)
+      char c = *(reinterpret_cast<char *>(&(req.data)));
+      if (console)
+        console->put(c);
+      else
+        fprintf(stderr, "%c", c);
+    } else if (req.addr == 0xFFFFFFF4) {
+    // When we write to [0xFFFFFFF4], ask for a checkpoint after this cycle
+      ret = 1;
     } else {
-      dmem->write_transcation(req->addr, reinterpret_cast<char *>(&(req->data)), data_size);
+      dmem->write_transcation(req.addr, reinterpret_cast<char *>(&(req.data)), data_size);
+      for (unsigned w = 0; w < num_watched; w++) {
+        if (req.addr < watched[w] + 8 && watched[w] < req.addr + data_size)
+          watched_write = true;
+      }
     }
 
-    delete req;
-    buffer.pop_front();
+    IndexStore(oldest, false);
+    count--;
+    stats.committed++;
   }
-  return 0;
+  return ret;
+}
+
+void StoreBuffer::WatchWord(unsigned int addr) {
+  if (num_watched == kWatchedWords) {
+    fprintf(stderr, "[Store Buffer] Error: more than %u watched words\n", kWatchedWords);
+    return;
+  }
+  watched[num_watched++] = addr;
 }
 
 void StoreBuffer::FlushStoreBuffer() {
-  while (!buffer.empty()) {
-    delete buffer.front();
-    buffer.pop_front();
+  stats.flushes++;
+  stats.flushed_stores += count;
+  stats.flush_sizes[count]++;
+  Clear();
+}
+
+void StoreBuffer::Clear() {
+  for (unsigned i = 0; i < count; i++) {
+    IndexStore(Slot(i), false);
   }
+  count = 0;
 }
 
-void StoreBuffer::LoadData(unsigned int load_addr, char* dest) {
-  unsigned int addr, size;
-  int offset;
-  unsigned long long data = 0;
-  char* data_ptr = reinterpret_cast<char *>(&data);
-  dmem->read_transction(load_addr, dest);
-  printf("Loading data: addr=0x%x, dest_data=0x%llx\n", load_addr, *((unsigned long long *)dest));
-  for (auto i = buffer.begin(); i != buffer.end(); i++) {
-    addr = (*i)->addr;
-    data = (*i)->data;
-    size = data_size_map[(*i)->size];
-    offset = addr - load_addr;
-    if (size == 1) { // byte
-      if (offset >= 0 && offset <= 7) {
-        memcpy(dest + offset, data_ptr, size);
-      }
-    } else if (size == 2) { // half word
-      if (offset >= 0 && offset <= 6) {
-        memcpy(dest + offset, data_ptr, size);
-      } else if (offset == 7) {
-        memcpy(dest + offset, data_ptr, 8 - offset);
-      } else if (offset == -1) {
-        memcpy(dest, data_ptr - offset, size + offset);
-      }
-    } else if (size == 4) { // word
-      if (offset >= 0 && offset <= 4) {
-        memcpy(dest + offset, data_ptr, size);
-      } else if (offset > 4 && offset <= 7) {
-        memcpy(dest + offset, data_ptr, 8 - offset);
-      } else if (offset >= -3 && offset < 0) {
-        memcpy(dest, data_ptr - offset, size + offset);
-      }
-    } else if (size == 8) { // double word
-      if (offset == 0) {
-        memcpy(dest + offset, data_ptr, size);
-      } else if (offset > 0 && offset <= 7) {
-        memcpy(dest + offset, data_ptr, 8 - offset);
-      } else if (offset >= -7 && offset < 0) {
-        memcpy(dest, data_ptr - offset, size + offset);
-      }
+// widen a mask of bytes to a mask of their bits
+static unsigned long long ByteMaskToBits(unsigned mask) {
+  unsigned long long x = mask;
+  x = (x | x << 28) & 0x0000000F0000000Full;
+  x = (x | x << 14) & 0x0003000300030003ull;
+  x = (x | x << 7) & 0x0101010101010101ull;
+  return x * 0xFF;
+}
+
+bool StoreBuffer::LoadData(unsigned int load_addr, char* dest) {
+  unsigned long long value = 0;
+  unsigned need = 0xFF;   // the bytes no store has provided yet
+
+  stats.loads++;
+  slot_mask_t candidates = word_index[Bucket(load_addr)] | word_index[Bucket(load_addr + 7)];
+  if (!candidates) {
+    dmem->read_transction(load_addr, dest);
+    if (SIM_MAX_LOG_LEVEL >= 2 && logging)
+      printf("Loading data: addr=0x%x, dest_data=0x%llx\n", load_addr, *((unsigned long long *)dest));
+    return false;
+  }
+
+  // rotate the mask so that bit i is the i-th youngest store
+  if (tail) {
+    candidates = ((candidates >> tail) | (candidates << (kCapacity - tail))) & kAllSlots;
+  }
+
+  // from the youngest store to the oldest, until all 8 bytes are provided
+  while (candidates && need) {
+    unsigned i = __builtin_ctzll(candidates);
+    candidates &= candidates - 1;
+    const store_request_t &req = ring[Slot(i)];
+    int offset = req.addr - load_addr;
+    if (offset <= -8 || offset >= 8) continue;
+
+    unsigned store_mask = (1u << data_size_map[req.size]) - 1;
+    unsigned long long data = req.data;
+    if (offset >= 0) {
+      store_mask = (store_mask << offset) & 0xFF;
+      data <<= 8 * offset;
+    } else {
+      store_mask >>= -offset;
+      data >>= 8 * -offset;
     }
+    unsigned long long take = ByteMaskToBits(store_mask & need);
+    value = (value & ~take) | (data & take);
+    need &= ~store_mask;
+  }
+
+  if (!need)
+    stats.forward_full++;
+  else if (need != 0xFF)
+    stats.forward_partial++;
+
+  if (need) {
+    unsigned long long memory;
+    dmem->read_transction(load_addr, reinterpret_cast<char *>(&memory));
+    unsigned long long keep = ByteMaskToBits(need);
+    value = (value & ~keep) | (memory & keep);
+  }
+  memcpy(dest, &value, sizeof value);
+
+  if (SIM_MAX_LOG_LEVEL >= 2 && logging)
+    printf("Loading data: addr=0x%x, dest_data=0x%llx\n", load_addr, value);
+  return !need;
+}
+
+void StoreBuffer::Save(std::ostream &os) const {
+  ckpt_write<unsigned long long>(os, count);
+  for (unsigned i = count; i-- > 0; ) {
+    const store_request_t &req = ring[Slot(i)];
+    ckpt_write(os, req.addr);
+    ckpt_write(os, req.data);
+    ckpt_write(os, req.size);
+  }
+}
+
+void StoreBuffer::Restore(std::istream &is) {
+  unsigned long long num;
+  Clear();
+  ckpt_read(is, num);
+  for (unsigned long long i = 0; i < num; i++) {
+    unsigned int addr;
+    unsigned long long data;
+    unsigned char size;
+    ckpt_read(is, addr);
+    ckpt_read(is, data);
+    ckpt_read(is, size);
+    if (AddStoreRequest(addr, data, size) == -1)
+      throw std::runtime_error("checkpoint: too many pending stores");
   }
 }
+
+// print the non-zero buckets of a histogram, "<i>: <count>"
+template <size_t N>
+static void PrintHistogram(FILE *out, const char *name, const std::array<unsigned long long, N> &hist) {
+  fprintf(out, "[Store Buffer]   %s:", name);
+  for (size_t i = 0; i < N; i++) {
+    if (hist[i]) fprintf(out, " %zu: %llu", i, hist[i]);
+  }
+  fprintf(out, "\n");
+}
+
+void StoreBuffer::Stats::Print(FILE *out) const {
+  unsigned long long occupied = 0, max_occupancy = 0;
+  for (size_t i = 0; i < occupancy.size(); i++) {
+    occupied += i * occupancy[i];
+    if (occupancy[i]) max_occupancy = i;
+  }
+  fprintf(out, "[Store Buffer] %llu stores, %llu committed, %llu flushed by %llu recoveries\n",
+          stores, committed, flushed_stores, flushes);
+  fprintf(out, "[Store Buffer] %llu loads, %llu fully and %llu partially forwarded\n",
+          loads, forward_full, forward_partial);
+  fprintf(out, "[Store Buffer] occupancy over %llu cycles: mean %.2f, max %llu\n",
+          cycles, cycles ? (double) occupied / cycles : 0.0, max_occupancy);
+  PrintHistogram(out, "occupancy", occupancy);
+  PrintHistogram(out, "stores retired per cycle", commit_bursts);
+  PrintHistogram(out, "stores per flush", flush_sizes);
+}
+
+template <size_t N>
+static void WriteJsonArray(std::ostream &os, const std::array<unsigned long long, N> &hist) {
+  os << "[";
+  for (size_t i = 0; i < N; i++) {
+    os << (i ? ", " : "") << hist[i];
+  }
+  os << "]";
+}
+
+void StoreBuffer::Stats::WriteJson(std::ostream &os) const {
+  os << "{\n"
+     << "  \"capacity\": " << kCapacity << ",\n"
+     << "  \"stores\": " << stores << ",\n"
+     << "  \"committed\": " << committed << ",\n"
+     << "  \"loads\": " << loads << ",\n"
+     << "  \"forward_full\": " << forward_full << ",\n"
+     << "  \"forward_partial\": " << forward_partial << ",\n"
+     << "  \"flushes\": " << flushes << ",\n"
+     << "  \"flushed_stores\": " << flushed_stores << ",\n"
+     << "  \"cycles\": " << cycles << ",\n"
+     << "  \"occupancy\": ";
+  WriteJsonArray(os, occupancy);
+  os << ",\n  \"commit_bursts\": ";
+  WriteJsonArray(os, commit_bursts);
+  os << ",\n  \"flush_sizes\": ";
+  WriteJsonArray(os, flush_sizes);
+  os << "\n}\n";
+}
@@ -1,15 +1,19 @@
 #ifndef STORE_BUFFER_H
 #define STORE_BUFFER_H
 
-#include <list>
+#include <array>
+#include <cstdio>
 #include <memory>
+#include <iosfwd>
 
 #include "sim_memory.h"
+#include "console.h"
 
 typedef struct store_request {
   unsigned int addr;
   unsigned long long data;
   unsigned char size;
+  store_request() {}
   store_request(unsigned int a, unsigned long long d, unsigned char s) {
     addr = a;
     data = d;
@@ -17,26 +21,132 @@ typedef struct store_request {
   }
 } store_request_t;
 
+/*
+ * The stores that executed but did not retire yet, oldest first.
+ *
+ * The entries live inline in a ring of kCapacity slots: a store can only
+ * be pending while it holds a ROB entry, so ROB_SIZE (src/common/defines.svh)
+ * slots are enough.  For store-to-load forwarding every 8-byte word hashes
+ * to a bucket holding the mask of the slots whose store touches a word of
+ * that bucket, a load only looks at the slots in the masks of its two words,
+ * youngest first, and stops once every byte it reads is provided.
+ */
 class StoreBuffer {
 public:
+  static constexpr unsigned kCapacity = 64;   // `ROB_SIZE
+  static constexpr unsigned kCommitWidth = 6;  // `COMMIT_WIDTH
+  static constexpr unsigned kWatchedWords = 2;
+
+  // what the buffer went through, to size the LSQ and to spot kernels
+  // with many mispredictions
+  struct Stats {
+    unsigned long long stores = 0;
+    unsigned long long committed = 0;
+    unsigned long long loads = 0;
+    unsigned long long forward_full = 0;     // all 8 bytes from stores
+    unsigned long long forward_partial = 0;  // some bytes from stores
+    unsigned long long flushes = 0;
+    unsigned long long flushed_stores = 0;   // speculative stores discarded
+    unsigned long long cycles = 0;           // # of CommitStoreRequest calls
+    // # of cycles with i pending stores, resp. i stores retired
+    std::array<unsigned long long, kCapacity + 1> occupancy{};
+    std::array<unsigned long long, kCommitWidth + 1> commit_bursts{};
+    // # of flushes that discarded i stores
+    std::array<unsigned long long, kCapacity + 1> flush_sizes{};
+
+    void Print(FILE *out) const;
+    void WriteJson(std::ostream &os) const;
+  };
+
   StoreBuffer(std::unique_ptr<DMem> dm) : dmem(std::move(dm)) { }
 
-  ~StoreBuffer() { FlushStoreBuffer(); }
+  ~StoreBuffer() { Clear(); }
 
-  void AddStoreRequest(store_request_t* req);
+  // return 0 for normal store
+  // return -1 when the buffer is full
+  int AddStoreRequest(unsigned int addr, unsigned long long data, unsigned char size);
 
+  // called once per cycle with the # of stores retiring
   // return 0 for normal store
-  // return 1 for halt (unused now)
+  // return 1 when the target asks for a checkpoint
+  // return -1 for halt
+  // return -2 when more stores retire than are pending
   int CommitStoreRequest(unsigned int num_commit);
 
+  // discard the stores of a mispredicted path
   void FlushStoreBuffer();
 
-  void LoadData(unsigned int load_addr, char* dest);
+  // read the 8 bytes at <load_addr> as the core sees them: each byte from
+  // the youngest pending store that writes it, or else from memory.
+  // Return true when the stores provide all of them, memory is not read.
+  bool LoadData(unsigned int load_addr, char* dest);
+
+  unsigned Size() const { return count; }
+
+  // the i-th oldest pending store, i < Size(): the one that retires next is 0
+  const store_request_t &Pending(unsigned i) const { return ring[Slot(count - 1 - i)]; }
+
+  // note the retiring stores that write the 8 bytes at <addr>, e.g. to
+  // tohost and fromhost, up to kWatchedWords of them
+  void WatchWord(unsigned int addr);
+
+  // where the characters stored to 0xFFFFFFF8 go, a console on stderr in
+  // sim_main2, stderr unbuffered when not set
+  void SetConsole(console_t *c) { console = c; }
+
+  // whether a watched word was written since the last call
+  bool TakeWatchedWrite() {
+    bool written = watched_write;
+    watched_write = false;
+    return written;
+  }
+
+  const Stats &GetStats() const { return stats; }
+
+  // print every store and load, on by default
+  void SetLogging(bool on) { logging = on; }
+
+  // save / restore the pending (not yet committed) stores
+  void Save(std::ostream &os) const;
+  void Restore(std::istream &is);
 
 private:
+  static_assert(kCapacity <= 64 && (kCapacity & (kCapacity - 1)) == 0,
+                "a slot mask has to fit in 64 bits");
+  static constexpr unsigned kIndexBuckets = 256;
+
+  typedef unsigned long long slot_mask_t;
+  static constexpr slot_mask_t kAllSlots = kCapacity == 64 ? ~0ull : (1ull << (kCapacity % 64)) - 1;
+
   std::unique_ptr<DMem> dmem;
 
-  std::list<store_request_t*> buffer;
+  bool logging = true;
+
+  Stats stats;
+
+  std::array<store_request_t, kCapacity> ring;
+  // the ring grows down: the youngest store is at <tail>, the older ones
+  // follow it, so a load can scan the rotated slot mask from bit 0
+  unsigned tail = 0;
+  unsigned count = 0;
+
+  std::array<slot_mask_t, kIndexBuckets> word_index{};
+
+  std::array<unsigned int, kWatchedWords> watched{};
+  unsigned num_watched = 0;
+  bool watched_write = false;
+
+  console_t *console = nullptr;
+
+  static unsigned Bucket(unsigned int addr) { return (addr >> 3) % kIndexBuckets; }
+
+  // the slot of the i-th youngest store
+  unsigned Slot(unsigned i) const { return (tail + i) % kCapacity; }
+
+  void IndexStore(unsigned slot, bool insert);
+
+  // drop the pending stores without counting them as flushed
+  void Clear();
 };
 
 #endif /* STORE_BUFFER_H */
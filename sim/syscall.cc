@@ -3,6 +3,7 @@
 #include "syscall.h"
 #include "htif.h"
 #include "byteorder.h"
+#include "checkpoint.h"
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/stat.h>
@@ -13,6 +14,7 @@
 #include <termios.h>
 #include <sstream>
 #include <iostream>
+#include <algorithm>
 using namespace std::placeholders;
 
 #define RISCV_AT_FDCWD -100
@@ -167,6 +169,7 @@ syscall_t::syscall_t(htif_t* htif)
   table[2012] = &syscall_t::sys_printstr;
 
   register_command(0, std::bind(&syscall_t::handle_syscall, this, _1), "syscall");
+  register_command(1, std::bind(&syscall_t::handle_syscall_batch, this, _1), "syscall_batch");
 
   int stdin_fd = dup(0), stdout_fd0 = dup(1), stdout_fd1 = dup(1);
   if (stdin_fd < 0 || stdout_fd0 < 0 || stdout_fd1 < 0)
@@ -194,6 +197,14 @@ std::string syscall_t::undo_chroot(const char* fn)
   return "/";
 }
 
+std::string syscall_t::read_path(reg_t addr, reg_t len)
+{
+  std::string path(std::min<reg_t>(len, PATH_MAX), 0);
+  if (!path.empty())
+    path.resize(memif->read_string(addr, path.size(), &path[0]));
+  return path;
+}
+
 void syscall_t::handle_syscall(command_t cmd)
 {
   if (cmd.payload() & 1) // test pass/fail
@@ -204,12 +215,95 @@ void syscall_t::handle_syscall(command_t cmd)
       std::cerr << "*** FAILED *** (tohost = " << htif->exit_code() << ")" << std::endl;
     return;
   }
-  else // proxied system call
-    dispatch(cmd.payload());
+  else if (!dispatch(cmd.payload())) // proxied system call
+  {
+    pending_respond = [cmd]() mutable { cmd.respond(1); };
+    return;
+  }
 
   cmd.respond(1);
 }
 
+// the payload holds the # of records in bits 32 to 47 and the guest
+// address of the array in the low 32 bits; the records run in order, each
+// gets its result in its first word as from the syscall command, and the
+// command is answered once, after the last one
+void syscall_t::handle_syscall_batch(command_t cmd)
+{
+  reg_t count = cmd.payload() >> 32;
+  if (count > MAX_BATCH)
+    throw std::runtime_error("syscall batch of " + std::to_string(count) + " records");
+
+  batch_next = cmd.payload() & 0xffffffff;
+  batch_end = batch_next + count * 8 * sizeof(reg_t);
+  if (!run_batch())
+  {
+    pending_respond = [cmd]() mutable { cmd.respond(1); };
+    return;
+  }
+
+  cmd.respond(1);
+}
+
+// false when a record went to the worker, the batch goes on when it completes
+bool syscall_t::run_batch()
+{
+  while (batch_next != batch_end)
+  {
+    addr_t mm = batch_next;
+    batch_next += 8 * sizeof(reg_t);
+    if (!dispatch(mm))
+      return false;
+  }
+  return true;
+}
+
+void syscall_t::set_console(console_t* c)
+{
+  console->flush();
+  console = c;
+  for (reg_t fd = 1; fd <= 2; fd++)
+    dup2(console->fd(), fds.lookup(fd));
+}
+
+void syscall_t::set_async(bool on)
+{
+  finish_io();
+  worker.reset(on ? new io_worker_t : nullptr);
+}
+
+void syscall_t::tick()
+{
+  reg_t ret;
+  if (io_pending() && worker->poll(ret))
+    complete_io(ret);
+}
+
+// the rest of a batch may go to the worker again
+void syscall_t::finish_io()
+{
+  while (io_pending())
+    complete_io(worker->wait());
+}
+
+void syscall_t::complete_io(reg_t ret)
+{
+  // what the worker read, through memif so that the decoded instructions
+  // it overwrites are dropped
+  if (pending_store_len && sreg_t(ret) > 0)
+    memif->write(pending_buf, ret, &io_buf[0]);
+
+  target_endian<reg_t> res = htif->to_target(ret);
+  memif->write(pending_mm, sizeof(res), &res);
+
+  if (!run_batch())
+    return;
+
+  std::function<void()> respond;
+  respond.swap(pending_respond);
+  respond();
+}
+
 reg_t syscall_t::sys_exit(reg_t code, reg_t a1, reg_t a2, reg_t a3, reg_t a4, reg_t a5, reg_t a6)
 {
   //std::cout << "called exit" << std::endl;
@@ -223,10 +317,65 @@ static reg_t sysret_errno(sreg_t ret)
   return ret == -1 ? -errno : ret;
 }
 
+// run <io>(iov, iovcnt, done) over <iov>, IOV_MAX ranges at a time, until
+// it transfers less than it was given; return the # of bytes, or -1 when
+// the first call fails
+template <typename F>
+static ssize_t iov_transfer(const std::vector<iovec>& iov, F io)
+{
+  ssize_t done = 0;
+  for (size_t i = 0; i < iov.size(); i += IOV_MAX)
+  {
+    int cnt = std::min<size_t>(IOV_MAX, iov.size() - i);
+    size_t want = 0;
+    for (int j = 0; j < cnt; j++)
+      want += iov[i + j].iov_len;
+    ssize_t ret = io(&iov[i], cnt, done);
+    if (ret < 0)
+      return done ? done : -1;
+    done += ret;
+    if ((size_t)ret < want)
+      break;
+  }
+  return done;
+}
+
+// transfer the guest buffer held in <iov> now, or leave it to the worker;
+// the console stays synchronous, in order with the output of the simulator.
+// The worker does not touch the guest pages: the target runs on meanwhile,
+// and a store of it may copy a page shared with a snapshot or an image, or
+// drop the mapping of the image.  It goes through <io_buf>, which holds a
+// write from now on, and a read is copied to the guest by complete_io
+reg_t syscall_t::iov_syscall(reg_t fd, reg_t pbuf, reg_t len, bool store, iov_func_t io)
+{
+  if (!worker || fd <= 2)
+    return sysret_errno(iov_transfer(iov, io));
+
+  io_buf.resize(len);
+  if (!store)
+    memif->read(pbuf, len, &io_buf[0]);
+  deferred = [v = std::vector<iovec>{{&io_buf[0], len}}, io]() { return sysret_errno(iov_transfer(v, io)); };
+  pending_buf = pbuf;
+  pending_store_len = store ? len : 0;
+  return 0;
+}
+
+// the guest buffers are read and written in place when the target memory
+// gives its host ranges, without a copy through a bounce buffer (but for
+// the worker, see iov_syscall)
 reg_t syscall_t::sys_read(reg_t fd, reg_t pbuf, reg_t len, reg_t a3, reg_t a4, reg_t a5, reg_t a6)
 {
+  if (fd == 0) // the prompt before the input
+    console->flush();
+  int host_fd = fds.lookup(fd);
+  iov.clear();
+  if (len && memif->host_iovecs(pbuf, len, true, iov))
+    return iov_syscall(fd, pbuf, len, true, [host_fd](const iovec* v, int cnt, ssize_t) {
+      return readv(host_fd, v, cnt);
+    });
+
   std::vector<char> buf(len);
-  ssize_t ret = read(fds.lookup(fd), &buf[0], len);
+  ssize_t ret = read(host_fd, &buf[0], len);
   reg_t ret_errno = sysret_errno(ret);
   if (ret > 0)
     memif->write(pbuf, ret, &buf[0]);
@@ -235,8 +384,15 @@ reg_t syscall_t::sys_read(reg_t fd, reg_t pbuf, reg_t len, reg_t a3, reg_t a4, r
 
 reg_t syscall_t::sys_pread(reg_t fd, reg_t pbuf, reg_t len, reg_t off, reg_t a4, reg_t a5, reg_t a6)
 {
+  int host_fd = fds.lookup(fd);
+  iov.clear();
+  if (len && memif->host_iovecs(pbuf, len, true, iov))
+    return iov_syscall(fd, pbuf, len, true, [host_fd, off](const iovec* v, int cnt, ssize_t done) {
+      return preadv(host_fd, v, cnt, off + done);
+    });
+
   std::vector<char> buf(len);
-  ssize_t ret = pread(fds.lookup(fd), &buf[0], len, off);
+  ssize_t ret = pread(host_fd, &buf[0], len, off);
   reg_t ret_errno = sysret_errno(ret);
   if (ret > 0)
     memif->write(pbuf, ret, &buf[0]);
@@ -245,21 +401,35 @@ reg_t syscall_t::sys_pread(reg_t fd, reg_t pbuf, reg_t len, reg_t off, reg_t a4,
 
 reg_t syscall_t::sys_write(reg_t fd, reg_t pbuf, reg_t len, reg_t a3, reg_t a4, reg_t a5, reg_t a6)
 {
-  //printf("sys_write\n");
-  char tbuf[100];
-  //getcwd(tbuf, sizeof tbuf);
-  //printf("cwd: %s\n", tbuf);
+  if (fd == 1 || fd == 2) // after the console output before it
+    console->flush();
+  int host_fd = fds.lookup(fd);
+  iov.clear();
+  if (len && memif->host_iovecs(pbuf, len, false, iov))
+    return iov_syscall(fd, pbuf, len, false, [host_fd](const iovec* v, int cnt, ssize_t) {
+      return writev(host_fd, v, cnt);
+    });
+
   std::vector<char> buf(len);
   memif->read(pbuf, len, &buf[0]);
-  reg_t ret = sysret_errno(write(fds.lookup(fd), &buf[0], len));
+  reg_t ret = sysret_errno(write(host_fd, &buf[0], len));
   return ret;
 }
 
 reg_t syscall_t::sys_pwrite(reg_t fd, reg_t pbuf, reg_t len, reg_t off, reg_t a4, reg_t a5, reg_t a6)
 {
+  if (fd == 1 || fd == 2)
+    console->flush();
+  int host_fd = fds.lookup(fd);
+  iov.clear();
+  if (len && memif->host_iovecs(pbuf, len, false, iov))
+    return iov_syscall(fd, pbuf, len, false, [host_fd, off](const iovec* v, int cnt, ssize_t done) {
+      return pwritev(host_fd, v, cnt, off + done);
+    });
+
   std::vector<char> buf(len);
   memif->read(pbuf, len, &buf[0]);
-  reg_t ret = sysret_errno(pwrite(fds.lookup(fd), &buf[0], len, off));
+  reg_t ret = sysret_errno(pwrite(host_fd, &buf[0], len, off));
   return ret;
 }
 
@@ -300,11 +470,10 @@ reg_t syscall_t::sys_ftruncate(reg_t fd, reg_t len, reg_t a2, reg_t a3, reg_t a4
 
 reg_t syscall_t::sys_lstat(reg_t pname, reg_t len, reg_t pbuf, reg_t a3, reg_t a4, reg_t a5, reg_t a6)
 {
-  std::vector<char> name(len);
-  memif->read(pname, len, &name[0]);
+  std::string name = read_path(pname, len);
 
   struct stat buf;
-  reg_t ret = sysret_errno(lstat(do_chroot(&name[0]).c_str(), &buf));
+  reg_t ret = sysret_errno(lstat(do_chroot(name.c_str()).c_str(), &buf));
   if (ret != (reg_t)-1)
   {
     riscv_stat rbuf(buf, htif);
@@ -318,11 +487,10 @@ reg_t syscall_t::sys_statx(reg_t fd, reg_t pname, reg_t len, reg_t flags, reg_t
 #ifndef HAVE_STATX
   return -ENOSYS;
 #else
-  std::vector<char> name(len);
-  memif->read(pname, len, &name[0]);
+  std::string name = read_path(pname, len);
 
   struct statx buf;
-  reg_t ret = sysret_errno(statx(fds.lookup(fd), do_chroot(&name[0]).c_str(), flags, mask, &buf));
+  reg_t ret = sysret_errno(statx(fds.lookup(fd), do_chroot(name.c_str()).c_str(), flags, mask, &buf));
   if (ret != (reg_t)-1)
   {
     riscv_statx rbuf(buf, htif);
@@ -338,10 +506,9 @@ reg_t syscall_t::sys_statx(reg_t fd, reg_t pname, reg_t len, reg_t flags, reg_t
 reg_t syscall_t::sys_openat(reg_t dirfd, reg_t pname, reg_t len, reg_t flags, reg_t mode, reg_t a5, reg_t a6)
 {
   //printf("openat\n");
-  std::vector<char> name(len);
-  memif->read(pname, len, &name[0]);
-  //printf("file is %s\n", &name[0]);
-  int fd = sysret_errno(AT_SYSCALL(openat, dirfd, &name[0], flags, mode));
+  std::string name = read_path(pname, len);
+  //printf("file is %s\n", name.c_str());
+  int fd = sysret_errno(AT_SYSCALL(openat, dirfd, name.c_str(), flags, mode));
   //printf("get fd %d\n", fd);
   if (fd < 0)
     return sysret_errno(-1);
@@ -350,11 +517,10 @@ reg_t syscall_t::sys_openat(reg_t dirfd, reg_t pname, reg_t len, reg_t flags, re
 
 reg_t syscall_t::sys_fstatat(reg_t dirfd, reg_t pname, reg_t len, reg_t pbuf, reg_t flags, reg_t a5, reg_t a6)
 {
-  std::vector<char> name(len);
-  memif->read(pname, len, &name[0]);
+  std::string name = read_path(pname, len);
 
   struct stat buf;
-  reg_t ret = sysret_errno(AT_SYSCALL(fstatat, dirfd, &name[0], &buf, flags));
+  reg_t ret = sysret_errno(AT_SYSCALL(fstatat, dirfd, name.c_str(), &buf, flags));
   if (ret != (reg_t)-1)
   {
     riscv_stat rbuf(buf, htif);
@@ -365,42 +531,35 @@ reg_t syscall_t::sys_fstatat(reg_t dirfd, reg_t pname, reg_t len, reg_t pbuf, re
 
 reg_t syscall_t::sys_faccessat(reg_t dirfd, reg_t pname, reg_t len, reg_t mode, reg_t a4, reg_t a5, reg_t a6)
 {
-  std::vector<char> name(len);
-  memif->read(pname, len, &name[0]);
-  return sysret_errno(AT_SYSCALL(faccessat, dirfd, &name[0], mode, 0));
+  std::string name = read_path(pname, len);
+  return sysret_errno(AT_SYSCALL(faccessat, dirfd, name.c_str(), mode, 0));
 }
 
 reg_t syscall_t::sys_renameat(reg_t odirfd, reg_t popath, reg_t olen, reg_t ndirfd, reg_t pnpath, reg_t nlen, reg_t a6)
 {
-  std::vector<char> opath(olen), npath(nlen);
-  memif->read(popath, olen, &opath[0]);
-  memif->read(pnpath, nlen, &npath[0]);
-  return sysret_errno(renameat(fds.lookup(odirfd), int(odirfd) == RISCV_AT_FDCWD ? do_chroot(&opath[0]).c_str() : &opath[0],
-                             fds.lookup(ndirfd), int(ndirfd) == RISCV_AT_FDCWD ? do_chroot(&npath[0]).c_str() : &npath[0]));
+  std::string opath = read_path(popath, olen), npath = read_path(pnpath, nlen);
+  return sysret_errno(renameat(fds.lookup(odirfd), int(odirfd) == RISCV_AT_FDCWD ? do_chroot(opath.c_str()).c_str() : opath.c_str(),
+                             fds.lookup(ndirfd), int(ndirfd) == RISCV_AT_FDCWD ? do_chroot(npath.c_str()).c_str() : npath.c_str()));
 }
 
 reg_t syscall_t::sys_linkat(reg_t odirfd, reg_t poname, reg_t olen, reg_t ndirfd, reg_t pnname, reg_t nlen, reg_t flags)
 {
-  std::vector<char> oname(olen), nname(nlen);
-  memif->read(poname, olen, &oname[0]);
-  memif->read(pnname, nlen, &nname[0]);
-  return sysret_errno(linkat(fds.lookup(odirfd), int(odirfd) == RISCV_AT_FDCWD ? do_chroot(&oname[0]).c_str() : &oname[0],
-                             fds.lookup(ndirfd), int(ndirfd) == RISCV_AT_FDCWD ? do_chroot(&nname[0]).c_str() : &nname[0],
+  std::string oname = read_path(poname, olen), nname = read_path(pnname, nlen);
+  return sysret_errno(linkat(fds.lookup(odirfd), int(odirfd) == RISCV_AT_FDCWD ? do_chroot(oname.c_str()).c_str() : oname.c_str(),
+                             fds.lookup(ndirfd), int(ndirfd) == RISCV_AT_FDCWD ? do_chroot(nname.c_str()).c_str() : nname.c_str(),
                              flags));
 }
 
 reg_t syscall_t::sys_unlinkat(reg_t dirfd, reg_t pname, reg_t len, reg_t flags, reg_t a4, reg_t a5, reg_t a6)
 {
-  std::vector<char> name(len);
-  memif->read(pname, len, &name[0]);
-  return sysret_errno(AT_SYSCALL(unlinkat, dirfd, &name[0], flags));
+  std::string name = read_path(pname, len);
+  return sysret_errno(AT_SYSCALL(unlinkat, dirfd, name.c_str(), flags));
 }
 
 reg_t syscall_t::sys_mkdirat(reg_t dirfd, reg_t pname, reg_t len, reg_t mode, reg_t a4, reg_t a5, reg_t a6)
 {
-  std::vector<char> name(len);
-  memif->read(pname, len, &name[0]);
-  return sysret_errno(AT_SYSCALL(mkdirat, dirfd, &name[0], mode));
+  std::string name = read_path(pname, len);
+  return sysret_errno(AT_SYSCALL(mkdirat, dirfd, name.c_str(), mode));
 }
 
 reg_t syscall_t::sys_getcwd(reg_t pbuf, reg_t size, reg_t a2, reg_t a3, reg_t a4, reg_t a5, reg_t a6)
@@ -445,29 +604,21 @@ reg_t syscall_t::sys_getmainvars(reg_t pbuf, reg_t limit, reg_t a2, reg_t a3, re
 
 reg_t syscall_t::sys_chdir(reg_t path, reg_t a1, reg_t a2, reg_t a3, reg_t a4, reg_t a5, reg_t a6)
 {
-  size_t size = 0;
-  while (memif->read_uint8(path + size++))
-    ;
-  std::vector<char> buf(size);
-  for (size_t offset = 0;; offset++)
-  {
-    buf[offset] = memif->read_uint8(path + offset);
-    if (!buf[offset])
-      break;
-  }
-  return sysret_errno(chdir(buf.data()));
+  return sysret_errno(chdir(read_path(path, PATH_MAX).c_str()));
 }
 
 reg_t syscall_t::sys_printstr(reg_t str, reg_t a1, reg_t a2, reg_t a3, reg_t a4, reg_t a5, reg_t a6){
-  char c = -1;
-  unsigned i = 0;
-  while ((c = memif->read_uint8(str + i++)) != 0) {
-    printf("%c", c);
+  char buf[256];
+  for (reg_t addr = str;; addr += sizeof(buf)) {
+    size_t len = memif->read_string(addr, sizeof(buf), buf);
+    console->write(buf, len);
+    if (len < sizeof(buf))
+      break;
   }
   return 0;
 }
 
-void syscall_t::dispatch(reg_t mm)
+bool syscall_t::dispatch(reg_t mm)
 {
   target_endian<reg_t> magicmem[8];
   memif->read(mm, sizeof(magicmem), magicmem);
@@ -478,7 +629,77 @@ void syscall_t::dispatch(reg_t mm)
 
   magicmem[0] = htif->to_target((this->*table[n])(htif->from_target(magicmem[1]), htif->from_target(magicmem[2]), htif->from_target(magicmem[3]), htif->from_target(magicmem[4]), htif->from_target(magicmem[5]), htif->from_target(magicmem[6]), htif->from_target(magicmem[7])));
 
+  if (deferred)
+  {
+    pending_mm = mm;
+    worker->submit(std::move(deferred));
+    deferred = nullptr;
+    return false;
+  }
+
   memif->write(mm, sizeof(magicmem), magicmem);
+  return true;
+}
+
+io_worker_t::io_worker_t()
+  : thread(&io_worker_t::run, this)
+{
+}
+
+io_worker_t::~io_worker_t()
+{
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    quit = true;
+  }
+  cond.notify_all();
+  thread.join();
+}
+
+void io_worker_t::submit(std::function<reg_t()> j)
+{
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    job = std::move(j);
+  }
+  cond.notify_all();
+}
+
+// called every cycle while a job is in flight, so no lock
+bool io_worker_t::poll(reg_t& ret)
+{
+  if (!finished.load(std::memory_order_acquire))
+    return false;
+  finished.store(false, std::memory_order_relaxed);
+  ret = result;
+  return true;
+}
+
+reg_t io_worker_t::wait()
+{
+  std::unique_lock<std::mutex> guard(lock);
+  cond.wait(guard, [this] { return finished.load(std::memory_order_relaxed); });
+  finished.store(false, std::memory_order_relaxed);
+  return result;
+}
+
+void io_worker_t::run()
+{
+  std::unique_lock<std::mutex> guard(lock);
+  while (true)
+  {
+    cond.wait(guard, [this] { return quit || job; });
+    if (!job)
+      return;
+    std::function<reg_t()> j;
+    j.swap(job);
+    guard.unlock();
+    reg_t ret = j();
+    guard.lock();
+    result = ret;
+    finished.store(true, std::memory_order_release);
+    cond.notify_all();
+  }
 }
 
 reg_t fds_t::alloc(int fd)
@@ -507,6 +728,75 @@ int fds_t::lookup(reg_t fd)
   return fd >= fds.size() ? -1 : fds[fd];
 }
 
+void fds_t::save(std::ostream& os, size_t keep)
+{
+  ckpt_write<uint64_t>(os, fds.size());
+  for (size_t i = 0; i < fds.size(); i++)
+  {
+    if (i < keep || fds[i] == -1)
+    {
+      ckpt_write(os, fds[i] != -1);
+      continue;
+    }
+
+    char link[64], path[PATH_MAX];
+    snprintf(link, sizeof(link), "/proc/self/fd/%d", fds[i]);
+    ssize_t len = readlink(link, path, sizeof(path) - 1);
+    if (len < 0)
+      throw std::runtime_error("checkpoint: cannot find the file of fd " + std::to_string(i));
+    path[len] = 0;
+
+    ckpt_write(os, true);
+    ckpt_write(os, std::string(path));
+    ckpt_write<int>(os, fcntl(fds[i], F_GETFL));
+    ckpt_write<int64_t>(os, lseek(fds[i], 0, SEEK_CUR));
+  }
+}
+
+void fds_t::restore(std::istream& is, size_t keep)
+{
+  uint64_t num;
+  ckpt_read(is, num);
+
+  for (size_t i = keep; i < fds.size(); i++)
+    if (fds[i] != -1)
+      close(fds[i]);
+  fds.resize(std::max<uint64_t>(num, keep), -1);
+
+  for (size_t i = 0; i < num; i++)
+  {
+    bool open_fd;
+    ckpt_read(is, open_fd);
+    if (i < keep)
+      continue;
+    fds[i] = -1;
+    if (!open_fd)
+      continue;
+
+    std::string path;
+    int flags;
+    int64_t offset;
+    ckpt_read(is, path);
+    ckpt_read(is, flags);
+    ckpt_read(is, offset);
+
+    int fd = open(path.c_str(), flags & ~(O_CREAT | O_TRUNC | O_EXCL));
+    if (fd < 0 || (offset >= 0 && lseek(fd, offset, SEEK_SET) < 0))
+      throw std::runtime_error("checkpoint: cannot reopen " + path);
+    fds[i] = fd;
+  }
+}
+
+void syscall_t::save_state(std::ostream& os)
+{
+  fds.save(os, 3);
+}
+
+void syscall_t::restore_state(std::istream& is)
+{
+  fds.restore(is, 3);
+}
+
 void syscall_t::set_chroot(const char* where)
 {
   char buf1[PATH_MAX], buf2[PATH_MAX];
@@ -5,8 +5,16 @@
 
 #include "device.h"
 #include "memif.h"
+#include "console.h"
 #include <vector>
 #include <string>
+#include <iosfwd>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
 
 class syscall_t;
 typedef reg_t (syscall_t::*syscall_func_t)(reg_t, reg_t, reg_t, reg_t, reg_t, reg_t, reg_t);
@@ -20,16 +28,65 @@ class fds_t
   reg_t alloc(int fd);
   void dealloc(reg_t fd);
   int lookup(reg_t fd);
+
+  // files are saved by path, flags and offset, then reopened on restore;
+  // the first <keep> fds (stdin/stdout/stderr) are kept as they are
+  void save(std::ostream& os, size_t keep);
+  void restore(std::istream& is, size_t keep);
  private:
   std::vector<int> fds;
 };
 
+// runs the host side of one syscall at a time on a thread of its own
+class io_worker_t
+{
+ public:
+  io_worker_t();
+  ~io_worker_t(); // finishes the job in flight
+
+  void submit(std::function<reg_t()> job);
+  // true once the job finished, with its result in <ret>
+  bool poll(reg_t& ret);
+  reg_t wait();
+
+ private:
+  void run();
+
+  std::mutex lock;
+  std::condition_variable cond;
+  std::function<reg_t()> job;
+  bool quit = false;
+  std::atomic<bool> finished{false};
+  reg_t result = 0;
+  std::thread thread;
+};
+
 class syscall_t : public device_t
 {
  public:
   syscall_t(htif_t*);
 
   void set_chroot(const char* where);
+
+  // sys_printstr writes to <c>, and the fds 1 and 2 of the target go
+  // where it goes
+  void set_console(console_t* c);
+
+  // the # of magicmem records a syscall_batch command may carry
+  static const size_t MAX_BATCH = 64;
+
+  // with <on>, the reads and writes of files other than the console run
+  // on a worker thread: the command is answered by tick() when the host
+  // I/O completes, and the target runs on (spinning on fromhost) meanwhile
+  void set_async(bool on);
+  bool io_pending() const { return bool(pending_respond); }
+  // wait for the I/O in flight, and the rest of its batch, and answer the
+  // command
+  void finish_io();
+  void tick();
+
+  void save_state(std::ostream& os);
+  void restore_state(std::istream& is);
   
  private:
   const char* identity() { return "syscall_proxy"; }
@@ -38,14 +95,37 @@ class syscall_t : public device_t
   memif_t* memif;
   std::vector<syscall_func_t> table;
   fds_t fds;
+  console_t default_console;
+  console_t* console = &default_console;
+  std::vector<iovec> iov;   // the guest buffer of a read / write, in the host
+  std::vector<char> io_buf; // the buffer of the read / write on the worker
+
+  // the I/O a sys_ function left to the worker, and the command it answers
+  std::unique_ptr<io_worker_t> worker;
+  std::function<reg_t()> deferred;
+  std::function<void()> pending_respond;
+  addr_t pending_mm = 0;
+  reg_t pending_buf = 0, pending_store_len = 0;
+  // the records of the batch that are still to run, [batch_next, batch_end)
+  addr_t batch_next = 0, batch_end = 0;
+
+  typedef std::function<ssize_t(const iovec*, int, ssize_t)> iov_func_t;
+  reg_t iov_syscall(reg_t fd, reg_t pbuf, reg_t len, bool store, iov_func_t io);
+  void complete_io(reg_t ret);
 
   void handle_syscall(command_t cmd);
-  void dispatch(addr_t mm);
+  void handle_syscall_batch(command_t cmd);
+  bool run_batch();
+  // false when the syscall went to the worker
+  bool dispatch(addr_t mm);
 
   std::string chroot;
   std::string do_chroot(const char* fn);
   std::string undo_chroot(const char* fn);
 
+  // a path of the guest, <len> (at most PATH_MAX) bytes with the NUL
+  std::string read_path(reg_t addr, reg_t len);
+
   reg_t sys_exit(reg_t, reg_t, reg_t, reg_t, reg_t, reg_t, reg_t);
   reg_t sys_openat(reg_t, reg_t, reg_t, reg_t, reg_t, reg_t, reg_t);
   reg_t sys_read(reg_t, reg_t, reg_t, reg_t, reg_t, reg_t, reg_t);
@@ -0,0 +1,106 @@
+#include "decode_cache.h"
+
+#include <cassert>
+#include <cstdio>
+
+/*
+ * The RV32IM decoder on a few known encodings, and the decode cache: hits,
+ * the words dropped by a write through DMem, and the retire profile.
+ *
+ * ./test_decode_cache
+ */
+
+struct decode_case_t {
+  unsigned raw;
+  const char *text;
+  rv_class_t kind;
+  unsigned rd, rs1, rs2;
+  int imm;
+};
+
+void decode_known() {
+  printf("//////////// TASK: %s ////////////\n", __func__);
+  const decode_case_t cases[] = {
+    {0x00000297, "auipc t0, 0x0",     rv_class_t::auipc,   5,  0,  0, 0},
+    {0x0182a283, "lw t0, 24(t0)",     rv_class_t::load,    5,  5,  0, 24},
+    {0x00028067, "jr t0",             rv_class_t::jalr,    0,  5,  0, 0},
+    {0x00112623, "sw ra, 12(sp)",     rv_class_t::store,   0,  2,  1, 12},
+    {0xfe000ee3, "beq zero, zero, -4", rv_class_t::branch,  0, 0,  0, -4},
+    {0xff9ff0ef, "jal ra, -8",        rv_class_t::jal,     1,  0,  0, -8},
+    {0x02b50533, "mul a0, a0, a1",    rv_class_t::mul_div, 10, 10, 11, 0},
+    {0x12345537, "lui a0, 0x12345",   rv_class_t::lui,    10,  0,  0, 0x12345000},
+    {0xff010113, "addi sp, sp, -16",  rv_class_t::op_imm,  2,  2,  0, -16},
+    {0x40355513, "srai a0, a0, 3",    rv_class_t::op_imm, 10, 10,  0, 0x403},
+    {0x00b50533, "add a0, a0, a1",    rv_class_t::op,     10, 10, 11, 0},
+    {0x00000000, "(zero)",            rv_class_t::illegal, 0,  0,  0, 0},
+  };
+  for (auto &c : cases) {
+    decoded_inst_t d = rv32_decode(c.raw);
+    printf("%08x %-20s %-8s rd=%u rs1=%u rs2=%u imm=%d\n", c.raw, c.text, rv_class_name(d.kind), d.rd, d.rs1, d.rs2, d.imm);
+    assert(d.kind == c.kind && d.rd == c.rd && d.rs1 == c.rs1 && d.rs2 == c.rs2 && d.imm == c.imm);
+    // only an R-type has a funct7
+    assert(d.funct7 == (c.kind == rv_class_t::op || c.kind == rv_class_t::mul_div ? c.raw >> 25 : 0));
+  }
+  assert(rv32_decode(0x00112623).writes_rd() == false);
+  assert(rv32_decode(0x00028067).writes_rd() == false);   // rd is x0
+  assert(rv32_decode(0xff9ff0ef).writes_rd() == true);
+}
+
+void invalidate_on_write() {
+  printf("//////////// TASK: %s ////////////\n", __func__);
+  auto mem = make_PagedMemory();
+  decode_cache_t cache(mem.get());
+  DMem dmem(mem.get());
+  dmem.set_decode_cache(&cache);
+
+  const unsigned code[] = {0x00000297, 0x0182a283, 0x00028067};
+  mem->write_bytes(reinterpret_cast<const char *>(code), sizeof code, 0x1000);
+
+  for (int round = 0; round < 2; ++round) {
+    for (unsigned i = 0; i < 3; ++i) assert(cache.decode(0x1000 + 4 * i).raw == code[i]);
+  }
+  assert(cache.miss_count() == 3 && cache.hit_count() == 3);
+
+  // a store to another page is not looked at, one to the code drops the word
+  unsigned value = 0x00b50533;
+  dmem.write_transcation(0x2000, reinterpret_cast<const char *>(&value), 4);
+  assert(cache.invalidation_count() == 0);
+  dmem.write_transcation(0x1006, reinterpret_cast<const char *>(&value), 2);
+  assert(cache.invalidation_count() == 1);
+  assert(cache.decode(0x1000).raw == code[0]);
+  assert(cache.decode(0x1004).raw == ((code[1] & 0xffff) | value << 16));
+  assert(cache.miss_count() == 4);
+
+  cache.clear();
+  assert(cache.decode(0x1008).raw == code[2]);
+  assert(cache.miss_count() == 5);
+  printf("%llu hits, %llu misses, %llu invalidations\n", cache.hit_count(), cache.miss_count(), cache.invalidation_count());
+}
+
+void profile_retired() {
+  printf("//////////// TASK: %s ////////////\n", __func__);
+  auto mem = make_PagedMemory();
+  decode_cache_t cache(mem.get());
+  retire_profile_t profile(&cache);
+
+  const unsigned code[] = {0x00000297, 0x0182a283, 0x00028067};
+  mem->write_bytes(reinterpret_cast<const char *>(code), sizeof code, 0x1000);
+
+  // a loop retired 100 times is decoded once
+  for (int round = 0; round < 100; ++round) {
+    for (unsigned i = 0; i < 3; ++i) profile.retire(0x1000 + 4 * i);
+  }
+  profile.print(stdout);
+  assert(profile.retired() == 300);
+  assert(profile.count(rv_class_t::auipc) == 100 && profile.count(rv_class_t::load) == 100 &&
+         profile.count(rv_class_t::jalr) == 100 && profile.count(rv_class_t::store) == 0);
+  assert(cache.miss_count() == 3 && cache.hit_count() == 297);
+}
+
+int main() {
+  decode_known();
+  invalidate_on_write();
+  profile_retired();
+  printf("all decodes match\n");
+  return 0;
+}
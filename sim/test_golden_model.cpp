@@ -0,0 +1,119 @@
+#include "golden_model.h"
+
+#include <cassert>
+#include <cstdio>
+#include <vector>
+
+/*
+ * The golden model on a short hand-assembled program: the corner cases of
+ * the M extension, the stores of a retire group seen by its later loads,
+ * the host written words and the control flow.
+ *
+ * ./test_golden_model
+ */
+
+enum { zero = 0, ra = 1, a0 = 10, a1, a2, a3, a4, a5, a6, a7, s2 = 18, s3, s4 };
+
+static unsigned r_type(unsigned f7, unsigned rs2, unsigned rs1, unsigned f3, unsigned rd) {
+  return f7 << 25 | rs2 << 20 | rs1 << 15 | f3 << 12 | rd << 7 | 0x33;
+}
+static unsigned i_type(int imm, unsigned rs1, unsigned f3, unsigned rd, unsigned op) {
+  return (imm & 0xfff) << 20 | rs1 << 15 | f3 << 12 | rd << 7 | op;
+}
+static unsigned s_type(int imm, unsigned rs2, unsigned rs1, unsigned f3) {
+  return (imm >> 5 & 0x7f) << 25 | rs2 << 20 | rs1 << 15 | f3 << 12 | (imm & 31) << 7 | 0x23;
+}
+static unsigned b_type(int imm, unsigned rs2, unsigned rs1, unsigned f3) {
+  return (imm >> 12 & 1) << 31 | (imm >> 5 & 0x3f) << 25 | rs2 << 20 | rs1 << 15 | f3 << 12 |
+         (imm >> 1 & 0xf) << 8 | (imm >> 11 & 1) << 7 | 0x63;
+}
+static unsigned j_type(int imm, unsigned rd) {
+  return (imm >> 20 & 1) << 31 | (imm >> 1 & 0x3ff) << 21 | (imm >> 11 & 1) << 20 | (imm >> 12 & 0xff) << 12 |
+         rd << 7 | 0x6f;
+}
+
+struct expect_t {
+  unsigned rd, value;
+};
+
+void run_program() {
+  printf("//////////// TASK: %s ////////////\n", __func__);
+  auto mem = make_PagedMemory();
+  decode_cache_t cache(mem.get());
+  golden_model_t model(mem.get(), &cache);
+
+  const std::vector<unsigned> code = {
+    0x80000000u | a0 << 7 | 0x37,            // lui a0, 0x80000
+    i_type(-1, zero, 0, a1, 0x13),           // addi a1, zero, -1
+    r_type(1, a1, a0, 4, a2),                // div a2, a0, a1: overflow
+    r_type(1, a1, a0, 6, a3),                // rem a3, a0, a1
+    r_type(1, zero, a0, 5, a4),              // divu a4, a0, zero
+    r_type(1, a1, a0, 1, a5),                // mulh a5, a0, a1
+    r_type(1, a1, a1, 2, a6),                // mulhsu a6, a1, a1
+    s_type(0x100, a1, zero, 2),              // sw a1, 0x100(zero)
+    i_type(0x101, zero, 4, a7, 0x03),        // lbu a7, 0x101(zero)
+    s_type(0x101, zero, zero, 0),            // sb zero, 0x101(zero)
+    i_type(0x100, zero, 2, s2, 0x03),        // lw s2, 0x100(zero)
+    b_type(8, a1, s2, 0),                    // beq s2, a1, 8: not taken
+    j_type(8, ra),                           // jal ra, 8
+    i_type(1, zero, 0, s3, 0x13),            // addi s3, zero, 1: skipped
+    i_type(0x400 | 4, a0, 5, s4, 0x13),      // srai s4, a0, 4
+  };
+  const unsigned base = 0x1000;
+  mem->write_bytes(reinterpret_cast<const char *>(code.data()), code.size() * 4, base);
+
+  const expect_t expected[] = {
+    {a0, 0x80000000}, {a1, 0xffffffff}, {a2, 0x80000000}, {a3, 0}, {a4, 0xffffffff},
+    {a5, 0}, {a6, 0xffffffff}, {0, 0}, {a7, 0xff}, {0, 0}, {s2, 0xffff00ff},
+    {0, 0}, {ra, base + 13 * 4}, {s4, 0xf8000000},
+  };
+
+  model.start(base);
+  unsigned stores = 0;
+  for (auto &e : expected) {
+    golden_retire_t r = model.step();
+    printf("pc=0x%08x %-8s rd=x%-2u value=0x%08x%s\n", r.pc, rv_class_name(r.inst->kind), r.rd, r.value,
+           r.store ? " store" : "");
+    assert(!r.illegal && !r.sync_rd);
+    assert(r.rd == e.rd && r.value == e.value);
+    stores += r.store;
+  }
+  assert(stores == 2);
+  assert(model.next_pc() == base + 15 * 4);
+
+  // the group retired without the stores reaching memory: a load sees 0
+  model.end_group();
+  model.start(base + 10 * 4);
+  golden_retire_t r = model.step();
+  assert(r.rd == s2 && r.value == 0);
+
+  // a host written word is not predicted
+  model.add_volatile_word(0x100);
+  model.start(base + 10 * 4);
+  r = model.step();
+  assert(r.rd == s2 && r.sync_rd);
+
+  // x0 stays 0 and the history ends with the last pc
+  model.set_reg(zero, 5);
+  assert(model.reg(zero) == 0);
+  assert(model.retired() == 16);
+  model.print_state(stdout);
+}
+
+void illegal() {
+  printf("//////////// TASK: %s ////////////\n", __func__);
+  auto mem = make_PagedMemory();
+  decode_cache_t cache(mem.get());
+  golden_model_t model(mem.get(), &cache);
+  model.start(0x2000);
+  assert(model.step().illegal);    // all zeroes
+  model.start(0x2002);
+  assert(model.step().illegal);    // misaligned
+}
+
+int main() {
+  run_program();
+  illegal();
+  printf("all instructions match\n");
+  return 0;
+}
@@ -0,0 +1,69 @@
+#include "run_budget.h"
+
+#include <cassert>
+#include <cstdio>
+
+/*
+ * The run budget of sim_main2, stepped the way its loop steps it: between
+ * two cycles the checkpoint, then the budgets, then one more cycle.
+ *
+ * ./test_run_budget
+ */
+
+struct run_t {
+  unsigned long long checkpoint = ~0ull;   // the cycle of the checkpoint, if any
+  unsigned long long cycles, insts;
+};
+
+static run_t run(run_budget_t budget, unsigned retired_per_cycle) {
+  run_t r;
+  while (true) {
+    if (budget.checkpoint_due()) r.checkpoint = budget.cycles;
+    if (budget.cycles_spent() || budget.insts_spent()) break;
+    budget.count_cycle(retired_per_cycle);
+  }
+  r.cycles = budget.cycles;
+  r.insts = budget.insts;
+  return r;
+}
+
+void checkpoint_and_stop_at_n() {
+  printf("//////////// TASK: %s ////////////\n", __func__);
+  const unsigned long long n = 1000;
+  run_budget_t budget;
+  budget.max_cycles = n;
+  budget.checkpoint_at = n;
+  run_t r = run(budget, 2);
+  printf("checkpoint at %llu, stopped at %llu\n", r.checkpoint, r.cycles);
+  assert(r.checkpoint == n && r.cycles == n && r.insts == 2 * n);
+}
+
+void restored_run() {
+  printf("//////////// TASK: %s ////////////\n", __func__);
+  // the budget counts from reset, not from the restore
+  run_budget_t budget;
+  budget.max_cycles = 1000;
+  budget.cycles = 600;
+  budget.insts = 1200;
+  run_t r = run(budget, 2);
+  assert(r.cycles == 1000 && r.insts == 2000);
+  assert(r.checkpoint == ~0ull);
+}
+
+void insts_budget() {
+  printf("//////////// TASK: %s ////////////\n", __func__);
+  // stops at the end of the cycle that reached it
+  run_budget_t budget;
+  budget.max_insts = 10;
+  budget.checkpoint_at = 2;
+  run_t r = run(budget, 3);
+  assert(r.cycles == 4 && r.insts == 12 && r.checkpoint == 2);
+}
+
+int main() {
+  checkpoint_and_stop_at_n();
+  restored_run();
+  insts_budget();
+  printf("all budgets match\n");
+  return 0;
+}
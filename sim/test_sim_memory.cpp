@@ -5,6 +5,7 @@
 #include <array>
 #include <cstdio>
 #include <cassert>
+#include <cstring>
 
 
 void read_print_16bytes(IdeaMemory *mem, unsigned addr) {
@@ -45,6 +46,93 @@ void store_print_bytes(IdeaMemory *mem, unsigned addr, unsigned size) {
     mem->write_bytes(bytes, 16, addr);
 }
 
+void snapshot_restore(IdeaMemory *mem, unsigned addr) {
+    printf("//////////// TASK: %s ////////////\n", __func__);
+    const char before[16] = "before snapshot";
+    const char after[16] = "after  snapshot";
+    char bytes[16];
+
+    mem->write_bytes(before, 16, addr);
+    auto snap = mem->take_snapshot();
+    mem->write_bytes(after, 16, addr);
+    mem->write_bytes(after, 16, addr + 0x10000);
+
+    // fill the caches with the new content before going back
+    mem->read_bytes(bytes, addr, 16);
+    assert(std::memcmp(bytes, after, 16) == 0);
+
+    for (int round = 0; round < 2; ++round) {
+      mem->restore_snapshot(*snap);
+      mem->read_bytes(bytes, addr, 16);
+      printf("restore %d at 0x%x: %.16s\n", round, addr, bytes);
+      assert(std::memcmp(bytes, before, 16) == 0);
+      assert(mem->read<unsigned long long>(addr + 0x10000) == 0);
+      mem->write_bytes(after, 16, addr);
+    }
+}
+
+void fetch_elision(IdeaMemory *mem, unsigned addr) {
+    printf("//////////// TASK: %s ////////////\n", __func__);
+    const char code[16] = "0123456789abcde";
+    const char patch[4] = "xyz";
+    char line[16];
+    IMem imem(mem);
+
+    mem->write_bytes(code, 16, addr);
+    imem.read_transction(addr, line);
+    imem.read_transction(addr, line);
+    assert(imem.elided_fetch_count() == 1);
+
+    // a store, a snapshot restore, another address: the line is fetched again
+    DMem dmem(mem);
+    auto snap = mem->take_snapshot();
+    dmem.write_transcation(addr + 4, patch, 4);
+    imem.read_transction(addr, line);
+    assert(std::memcmp(line + 4, patch, 4) == 0);
+    mem->restore_snapshot(*snap);
+    imem.read_transction(addr, line);
+    assert(std::memcmp(line, code, 16) == 0);
+    imem.read_transction(addr + 16, line);
+    imem.read_transction(addr, line);
+    assert(std::memcmp(line, code, 16) == 0);
+    printf("%llu fetches, %llu elided\n", imem.fetch_count(), imem.elided_fetch_count());
+    assert(imem.fetch_count() == 6 && imem.elided_fetch_count() == 1);
+}
+
+void read_string(IdeaMemory *mem, unsigned addr) {
+    printf("//////////// TASK: %s ////////////\n", __func__);
+    // across a bucket and a page boundary, and unterminated in the range
+    std::string path(5000, 'p');
+    addr = (addr | 0xfff) - 100;
+    mem->write_bytes(path.c_str(), path.size() + 1, addr);
+    std::string out(6000, 'x');
+    assert(mem->read_string(&out[0], addr, out.size()) == path.size());
+    assert(std::memcmp(out.c_str(), path.c_str(), path.size() + 1) == 0);
+    assert(mem->read_string(&out[0], addr, 64) == 64);
+    assert(mem->read_string(&out[0], addr + 5000, 64) == 0 && out[0] == 0);
+}
+
+void host_iovecs(IdeaMemory *mem, unsigned addr) {
+    printf("//////////// TASK: %s ////////////\n", __func__);
+    // a store through the ranges, as a readv would do, then a load
+    std::string data(10000, 0);
+    for (unsigned i = 0; i < data.size(); ++i) data[i] = i * 7;
+    std::vector<iovec> iov;
+    mem->host_iovecs(addr + 100, data.size(), mem_access_t::store, iov);
+    size_t pos = 0;
+    for (auto &v : iov) {
+        std::memcpy(v.iov_base, data.data() + pos, v.iov_len);
+        pos += v.iov_len;
+    }
+    assert(pos == data.size());
+    std::string back(data.size(), 0);
+    mem->read_bytes(&back[0], addr + 100, back.size());
+    assert(back == data);
+    iov.clear();
+    mem->host_iovecs(addr + 100, data.size(), mem_access_t::load, iov);
+    printf("%zu ranges\n", iov.size());
+}
+
 void print_all(IdeaMemory *mem){
     printf("//////////// TASK: %s ////////////\n", __func__);
     mem->print_all();
@@ -90,5 +178,14 @@ int main(int argc, char** argv, char** env) {
     read_print_16bytes(bucket_memory.get(), 0x20);
     read_print_16bytes(bucket_memory.get(), 0x40);
     read_print_16bytes(bucket_memory.get(), 0x19f);
-    
+
+    for (auto kind : {"bucket", "flat", "paged"}) {
+      printf("snapshot of %s memory\n", kind);
+      auto memory = make_IdeaMemory(kind);
+      load_print_image(memory.get(), binName, 0x1000);
+      snapshot_restore(memory.get(), 0x1ff8);
+      fetch_elision(memory.get(), 0x3000);
+      read_string(memory.get(), 0x5000);
+      host_iovecs(memory.get(), 0x9000);
+    }
 }
@@ -0,0 +1,151 @@
+#include "store_buffer.h"
+
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/*
+ * Randomized differential test of the store-to-load forwarding.
+ *
+ * The reference keeps the pending stores in a vector and builds a load
+ * byte by byte: the memory, overwritten by every overlapping store from
+ * the oldest to the youngest.  A load is fully forwarded when the stores
+ * cover its 8 bytes, and then BucketMemory must not see an access.
+ *
+ * ./test_store_buffer [seed] [# of operations]
+ */
+
+struct reference_t {
+  IdeaMemory *mem;
+  std::vector<store_request_t> pending;
+
+  bool load(unsigned load_addr, unsigned char *dest) {
+    unsigned covered = 0;
+    mem->read_bytes(reinterpret_cast<char *>(dest), load_addr, 8);
+    for (auto &req : pending) {
+      for (unsigned b = 0; b < data_size_map[req.size]; ++b) {
+        unsigned pos = req.addr + b - load_addr;
+        if (pos >= 8) continue;
+        dest[pos] = reinterpret_cast<const unsigned char *>(&req.data)[b];
+        covered |= 1u << pos;
+      }
+    }
+    return covered == 0xFF;
+  }
+
+  void commit(unsigned num) {
+    for (unsigned i = 0; i < num; ++i) {
+      auto &req = pending[i];
+      mem->write_bytes(reinterpret_cast<const char *>(&req.data), data_size_map[req.size], req.addr);
+    }
+    pending.erase(pending.begin(), pending.begin() + num);
+  }
+};
+
+// stores around <base>, a few land on words that share its index buckets
+static unsigned random_addr(std::mt19937 &rng, unsigned base) {
+  unsigned addr = base + rng() % 48;
+  if (rng() % 8 == 0) addr += 2048 * (1 + rng() % 4);
+  return addr;
+}
+
+void random_forwarding(unsigned seed, unsigned ops) {
+  printf("//////////// TASK: %s seed=%u ////////////\n", __func__, seed);
+  std::mt19937 rng(seed);
+  auto mem = make_BucketMemory();
+  auto ref_mem = make_BucketMemory();
+  StoreBuffer buffer(std::make_unique<DMem>(mem.get()));
+  buffer.SetLogging(false);
+  reference_t ref{ref_mem.get(), {}};
+
+  const unsigned base = 0x2000;
+  unsigned long long loads = 0, full = 0;
+  bool full_checked = false;
+  for (unsigned op = 0; op < ops; ++op) {
+    unsigned r = rng() % 16;
+    if (r < 6) {
+      unsigned addr = random_addr(rng, base);
+      unsigned long long data = (unsigned long long) rng() << 32 | rng();
+      unsigned char size = rng() % 4;
+      // a full buffer refuses the store once, then it is drained a bit
+      if (ref.pending.size() == StoreBuffer::kCapacity && !full_checked) {
+        assert(buffer.AddStoreRequest(addr, data, size) == -1);
+        full_checked = true;
+      } else if (ref.pending.size() < StoreBuffer::kCapacity) {
+        assert(buffer.AddStoreRequest(addr, data, size) == 0);
+        ref.pending.push_back(store_request_t(addr, data, size));
+      }
+    } else if (r < 8) {
+      unsigned num = rng() % 7;   // COMMIT_WIDTH
+      if (num > ref.pending.size()) num = ref.pending.size();
+      assert(buffer.CommitStoreRequest(num) == 0);
+      ref.commit(num);
+    } else if (r == 8 && rng() % 4 == 0) {
+      buffer.FlushStoreBuffer();
+      ref.pending.clear();
+    } else if (r == 9 && rng() % 16 == 0) {
+      std::stringstream ss;
+      buffer.Save(ss);
+      buffer.Restore(ss);
+    } else {
+      unsigned addr = random_addr(rng, base - 8);
+      unsigned char got[8], expect[8];
+      unsigned long long lookups = mem->lookup_count();
+      bool fully = buffer.LoadData(addr, reinterpret_cast<char *>(got));
+      bool expect_fully = ref.load(addr, expect);
+      if (std::memcmp(got, expect, 8) != 0 || fully != expect_fully) {
+        printf("mismatch at op %u, load 0x%x\n", op, addr);
+        assert(false);
+      }
+      assert(!fully || mem->lookup_count() == lookups);
+      ++loads;
+      full += fully;
+    }
+    assert(buffer.Size() == ref.pending.size());
+  }
+  printf("%llu loads, %llu fully forwarded\n", loads, full);
+}
+
+// only the retiring stores that overlap a watched word are reported
+void watched_words() {
+  printf("//////////// TASK: %s ////////////\n", __func__);
+  auto mem = make_BucketMemory();
+  StoreBuffer buffer(std::make_unique<DMem>(mem.get()));
+  buffer.SetLogging(false);
+  buffer.WatchWord(0x1000);
+  buffer.WatchWord(0x1040);
+
+  buffer.AddStoreRequest(0x0ffc, 1, 2);
+  buffer.AddStoreRequest(0x1008, 2, 3);
+  assert(buffer.CommitStoreRequest(2) == 0);
+  assert(!buffer.TakeWatchedWrite());
+
+  buffer.AddStoreRequest(0x1044, 3, 2);
+  assert(!buffer.TakeWatchedWrite());   // not retired yet
+  buffer.FlushStoreBuffer();
+  assert(!buffer.TakeWatchedWrite());
+
+  buffer.AddStoreRequest(0x0ffe, 4, 2);  // the last 2 bytes land on 0x1000
+  assert(buffer.CommitStoreRequest(1) == 0);
+  assert(buffer.TakeWatchedWrite());
+  assert(!buffer.TakeWatchedWrite());
+
+  buffer.AddStoreRequest(0x1044, 5, 2);
+  assert(buffer.CommitStoreRequest(1) == 0);
+  assert(buffer.TakeWatchedWrite());
+}
+
+int main(int argc, char **argv) {
+  unsigned seed = argc > 1 ? std::stoul(argv[1]) : 450;
+  unsigned ops = argc > 2 ? std::stoul(argv[2]) : 1000000;
+  for (unsigned i = 0; i < 4; ++i) {
+    random_forwarding(seed + i, ops);
+  }
+  watched_words();
+  printf("all loads match\n");
+  return 0;
+}
@@ -0,0 +1,269 @@
+#include "sim_memory.h"
+#include "sim.h"
+
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+/*
+ * The syscall device through process_htio, as the program drives it: the
+ * syscall and syscall_batch commands, with and without --async-syscalls.
+ * The elf only gives the tohost and fromhost addresses.
+ *
+ * ./test_syscall [<elf>]    (sobel.elf by default)
+ */
+
+static const char *elf = "sobel.elf";
+
+static const unsigned kRecords = 0x200000;   // the magicmem records
+static const unsigned kPath = 0x300000;
+static const unsigned kData = 0x310000;      // the data of the writes, 0x100 apart
+static const unsigned kImage = 0x400000;     // a mapped image, page aligned
+static const uint64_t kBatch = 1ull << 48;   // command 1 of device 0
+
+struct host_t {
+  std::unique_ptr<IdeaMemory> mem = make_PagedMemory();
+  sim_t sim;
+  unsigned tohost, fromhost;
+  std::string path;
+
+  host_t(bool async) : sim({elf}, mem.get()) {
+    sim.set_async_syscalls(async);
+    sim.start();
+    tohost = sim.get_tohost_addr();
+    fromhost = sim.get_fromhost_addr();
+    char name[] = "/tmp/test_syscall.XXXXXX";
+    close(mkstemp(name));
+    path = name;
+  }
+
+  ~host_t() { unlink(path.c_str()); }
+
+  uint64_t read64(unsigned addr) {
+    uint64_t v;
+    mem->read_bytes(reinterpret_cast<char *>(&v), addr, sizeof v);
+    return v;
+  }
+
+  void write64(unsigned addr, uint64_t v) { mem->write_bytes(reinterpret_cast<const char *>(&v), sizeof v, addr); }
+
+  void set_record(unsigned i, uint64_t n, uint64_t a0 = 0, uint64_t a1 = 0, uint64_t a2 = 0, uint64_t a3 = 0,
+                  uint64_t a4 = 0) {
+    const uint64_t rec[8] = {n, a0, a1, a2, a3, a4};
+    mem->write_bytes(reinterpret_cast<const char *>(rec), sizeof rec, kRecords + 64 * i);
+  }
+
+  uint64_t result(unsigned i) { return read64(kRecords + 64 * i); }
+
+  // the two words of tohost, the high one first, as an RV32 program stores them
+  void send(uint64_t cmd) {
+    mem->write_bytes(reinterpret_cast<const char *>(&cmd) + 4, 4, tohost + 4);
+    sim.process_htio();
+    mem->write_bytes(reinterpret_cast<const char *>(&cmd), 4, tohost);
+    sim.process_htio();
+  }
+
+  // poll as the program spins on fromhost, return the response
+  uint64_t wait_response() {
+    uint64_t resp;
+    while (!(resp = read64(fromhost))) sim.process_htio();
+    write64(fromhost, 0);
+    return resp;
+  }
+
+  // a file open for writing as guest fd
+  uint64_t open_file(int flags = O_WRONLY | O_TRUNC) {
+    mem->write_bytes(path.c_str(), path.size() + 1, kPath);
+    set_record(0, 56, (uint64_t) -100, kPath, path.size() + 1, flags, 0);
+    send(kRecords);
+    assert(wait_response() == 1);
+    uint64_t fd = result(0);
+    assert((int64_t) fd > 2);
+    return fd;
+  }
+
+  // records 0 to n - 1 write "<i>\n" to <fd>
+  std::string queue_writes(uint64_t fd, unsigned n) {
+    std::string expected;
+    for (unsigned i = 0; i < n; i++) {
+      std::string line = std::to_string(i) + "\n";
+      mem->write_bytes(line.data(), line.size(), kData + 0x100 * i);
+      set_record(i, 64, fd, kData + 0x100 * i, line.size());
+      expected += line;
+    }
+    return expected;
+  }
+
+  std::string file() {
+    std::ifstream is(path);
+    std::stringstream ss;
+    ss << is.rdbuf();
+    return ss.str();
+  }
+};
+
+void batch() {
+  printf("//////////// TASK: %s ////////////\n", __func__);
+  host_t h(false);
+  uint64_t fd = h.open_file();
+  std::string expected = h.queue_writes(fd, 3);
+  h.set_record(3, 57, fd);
+
+  // the command and count word alone is not taken
+  const uint64_t cmd = kBatch | 4ull << 32 | kRecords;
+  h.mem->write_bytes(reinterpret_cast<const char *>(&cmd) + 4, 4, h.tohost + 4);
+  h.sim.process_htio();
+  assert(h.read64(h.tohost) == (cmd & ~0xffffffffull));
+  assert(h.result(0) == 64 && h.read64(h.fromhost) == 0);
+
+  h.mem->write_bytes(reinterpret_cast<const char *>(&cmd), 4, h.tohost);
+  h.sim.process_htio();
+  assert(h.read64(h.tohost) == 0);
+
+  // one response, the results in the first word of each record
+  assert(h.wait_response() == (kBatch | 1));
+  for (unsigned i = 0; i < 3; i++) assert(h.result(i) == std::to_string(i).size() + 1);
+  assert(h.result(3) == 0);
+  for (int i = 0; i < 16; i++) h.sim.process_htio();
+  assert(h.read64(h.fromhost) == 0);
+  assert(h.file() == expected);
+  printf("%u records, one response\n", 4);
+}
+
+void empty_batch() {
+  printf("//////////// TASK: %s ////////////\n", __func__);
+  host_t h(false);
+  h.set_record(0, 64, 1, kData, 1);
+  h.send(kBatch | kRecords);
+  assert(h.wait_response() == (kBatch | 1));
+  assert(h.result(0) == 64);   // not run
+}
+
+void async_batch() {
+  printf("//////////// TASK: %s ////////////\n", __func__);
+  host_t h(true);
+  uint64_t fd = h.open_file();
+  const unsigned n = 8;
+  std::string expected = h.queue_writes(fd, n);
+  h.set_record(n, 57, fd);
+
+  // the writes go to the worker one after the other, the batch goes on
+  // from process_htio each time one completes
+  h.send(kBatch | uint64_t(n + 1) << 32 | kRecords);
+  assert(h.wait_response() == (kBatch | 1));
+  assert(!h.sim.io_pending());
+  for (unsigned i = 0; i < n; i++) assert(h.result(i) == std::to_string(i).size() + 1);
+  assert(h.result(n) == 0);
+  assert(h.file() == expected);
+}
+
+void answered_by_tick() {
+  printf("//////////// TASK: %s ////////////\n", __func__);
+  host_t h(true);
+  uint64_t fd = h.open_file();
+  const unsigned n = 8;
+  std::string expected = h.queue_writes(fd, n);
+
+  // as sim_main2 runs it: tohost is only read after the stores to it, the
+  // rest of the batch and the response come from the ticks
+  h.send(kBatch | uint64_t(n) << 32 | kRecords);
+  uint64_t resp;
+  while (!(resp = h.read64(h.fromhost))) h.sim.tick_devices();
+  assert(resp == (kBatch | 1));
+  assert(!h.sim.io_pending());
+  assert(h.file() == expected);
+}
+
+void async_write_from_image() {
+  printf("//////////// TASK: %s ////////////\n", __func__);
+  host_t h(true);
+
+  // 128 KiB mapped from a file, every page shared with the mapping
+  const unsigned size = 128 << 10;
+  std::string image(size, 0);
+  for (unsigned i = 0; i < size; i++) image[i] = (char) (i * 7 + i / 4096);
+  std::string image_file = h.path + ".img";
+  std::ofstream(image_file, std::ios::binary).write(image.data(), size);
+  h.mem->load_image_to(image_file, kImage);
+
+  // the guest writes it to a fifo: the worker blocks once the pipe is full
+  unlink(h.path.c_str());
+  assert(mkfifo(h.path.c_str(), 0600) == 0);
+  int rfd = open(h.path.c_str(), O_RDONLY | O_NONBLOCK);
+  assert(rfd >= 0);
+  fcntl(rfd, F_SETFL, 0);
+  uint64_t fd = h.open_file(O_WRONLY);
+  h.set_record(0, 64, fd, kImage, size);
+  h.send(kRecords);
+  assert(h.sim.io_pending());
+
+  // meanwhile the program stores to every page: each is copied away from
+  // the mapping, which goes with the last of them
+  for (unsigned off = 0; off < size; off += 4096) h.mem->write_bytes("x", 1, kImage + off);
+
+  std::string out;
+  char buf[4096];
+  while (out.size() < size) {
+    ssize_t n = read(rfd, buf, sizeof buf);
+    assert(n > 0);
+    out.append(buf, n);
+  }
+  close(rfd);
+  assert(h.wait_response() == 1);
+  assert(h.result(0) == size);
+  // the content at the write, not after the stores
+  assert(out == image);
+  unlink(image_file.c_str());
+}
+
+void async_read() {
+  printf("//////////// TASK: %s ////////////\n", __func__);
+  host_t h(true);
+  std::ofstream(h.path) << "read on the worker\n";
+  uint64_t fd = h.open_file(O_RDONLY);
+  h.set_record(0, 63, fd, kData, 64);
+  h.send(kRecords);
+  assert(h.wait_response() == 1);
+  assert(h.result(0) == 19);
+  char buf[20] = {};
+  h.mem->read_bytes(buf, kData, 19);
+  assert(std::string(buf) == "read on the worker\n");
+}
+
+void finish_io() {
+  printf("//////////// TASK: %s ////////////\n", __func__);
+  host_t h(true);
+  uint64_t fd = h.open_file();
+  const unsigned n = 8;
+  std::string expected = h.queue_writes(fd, n);
+
+  // as at a checkpoint: nothing is left in flight, the response is queued
+  h.send(kBatch | uint64_t(n) << 32 | kRecords);
+  h.sim.finish_io();
+  assert(!h.sim.io_pending());
+  for (unsigned i = 0; i < n; i++) assert(h.result(i) == std::to_string(i).size() + 1);
+  assert(h.file() == expected);
+  h.sim.process_htio();
+  assert(h.read64(h.fromhost) == (kBatch | 1));
+}
+
+int main(int argc, char **argv) {
+  if (argc > 1) elf = argv[1];
+  batch();
+  empty_batch();
+  async_batch();
+  answered_by_tick();
+  async_write_from_image();
+  async_read();
+  finish_io();
+  printf("all syscalls match\n");
+  return 0;
+}
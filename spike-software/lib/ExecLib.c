@@ -5,6 +5,7 @@ reg_t payload(reg_t reg) {
 }
 
 void tohost_exit(reg_t code) {
+  batch_flush();
   while (1) {
     tohost = (code << 1) | 1;
   }
@@ -16,6 +17,50 @@ void send_syscall() {
   fromhost = 0;
 }
 
+reg_t syscall_batch[SYSCALL_BATCH_SIZE][8];
+static reg_t batch_count = 0;
+
+void batch_flush() {
+  volatile uint32_t *cmd = (volatile uint32_t *) &tohost;
+
+  if (batch_count == 0) {
+    return;
+  }
+
+  // the command and the # of records go in the high word, first: the host
+  // takes the command once the low word, the address, is written
+  cmd[1] = (TOHOST_CMD_SYSCALL_BATCH << 16) | (uint32_t) batch_count;
+  cmd[0] = CASTPTR(syscall_batch);
+  while (!fromhost);
+  fromhost = 0;
+
+  batch_count = 0;
+}
+
+reg_t batch_syscall(reg_t n, reg_t a0, reg_t a1, reg_t a2) {
+  reg_t i;
+
+  if (batch_count == SYSCALL_BATCH_SIZE) {
+    batch_flush();
+  }
+
+  i = batch_count++;
+  syscall_batch[i][0] = n;
+  syscall_batch[i][1] = a0;
+  syscall_batch[i][2] = a1;
+  syscall_batch[i][3] = a2;
+  syscall_batch[i][4] = 0;
+  syscall_batch[i][5] = 0;
+  syscall_batch[i][6] = 0;
+  syscall_batch[i][7] = 0;
+
+  return i;
+}
+
+reg_t batch_write(reg_t fd, char *pbuf, reg_t len) {
+  return batch_syscall(SYSCALL_WRITE, fd, (reg_t) CASTPTR(pbuf), len);
+}
+
 reg_t strlen_e(char *str) {
   unsigned i = 0;
   while(str[i]) {
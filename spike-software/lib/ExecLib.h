@@ -29,10 +29,19 @@ typedef uint64_t reg_t;
 
 #define O_CREAT 00000100 
 
+// the commands of the syscall device, bits 48 to 55 of tohost
+#define TOHOST_CMD_SYSCALL 0
+#define TOHOST_CMD_SYSCALL_BATCH 1
+
+// syscalls queued in syscall_batch reach the host with one tohost write
+// (the host takes up to 64)
+#define SYSCALL_BATCH_SIZE 16
+
 
 extern reg_t tohost;
 extern reg_t fromhost;
 extern reg_t tohost_cmd[8];
+extern reg_t syscall_batch[SYSCALL_BATCH_SIZE][8];
 
 // helper if only I instruction set is implemented 
 reg_t strlen_e(char *str);
@@ -51,4 +60,12 @@ reg_t tohost_read(reg_t fd, char *pbuf, reg_t len);
 
 void send_syscall();
 
+// batched syscalls: the queued ones are sent when the batch is full, by
+// batch_flush() and at exit.  batch_syscall() returns the index of the
+// record, its result is in syscall_batch[i][0] once the batch is sent,
+// until the next syscall is queued
+reg_t batch_syscall(reg_t n, reg_t a0, reg_t a1, reg_t a2);
+reg_t batch_write(reg_t fd, char *pbuf, reg_t len);
+void batch_flush();
+
 #endif /* EXECLIB_H */
@@ -14,7 +14,10 @@ module prf_int_data (
   input  [`PRF_INT_WAYS-1:0] [31:0]                     rd_data,
   input  [`PRF_INT_WAYS-1:0]                            rd_en,
   output logic [`PRF_INT_WAYS-1:0] [31:0]               rs1_data,
-  output logic [`PRF_INT_WAYS-1:0] [31:0]               rs2_data
+  output logic [`PRF_INT_WAYS-1:0] [31:0]               rs2_data,
+  // co-simulation: the values of the retired registers
+  input  [`COMMIT_WIDTH-1:0] [`PRF_INT_INDEX_SIZE-1:0]  debug_index,
+  output logic [`COMMIT_WIDTH-1:0] [31:0]               debug_data
 );
 
   // multi-bank register file
@@ -46,6 +49,11 @@ module prf_int_data (
     end
   end
 
+  always_comb begin
+    for (int i = 0; i < `COMMIT_WIDTH; i++)
+      debug_data[i] = rf[0][debug_index[i]];
+  end
+
   always_ff @(posedge clock) begin
     if (reset) begin
       for (int i = 0; i < `PRF_INT_WAYS; i++)
@@ -73,7 +81,10 @@ module prf_int (
   
   output micro_op_t [`PRF_INT_WAYS-1:0]                 uop_out,
   output reg [`PRF_INT_WAYS-1:0] [31:0]                 rs1_data,
-  output reg [`PRF_INT_WAYS-1:0] [31:0]                 rs2_data
+  output reg [`PRF_INT_WAYS-1:0] [31:0]                 rs2_data,
+
+  input  [`COMMIT_WIDTH-1:0] [`PRF_INT_INDEX_SIZE-1:0]  debug_index,
+  output logic [`COMMIT_WIDTH-1:0] [31:0]               debug_data
 );
 
   logic [`PRF_INT_WAYS-1:0] [`PRF_INT_INDEX_SIZE-1:0] rs1_index, rs2_index;
@@ -136,7 +147,9 @@ module prf_int (
     .rd_data    (rd_data),
     .rd_en      (rd_en),
     .rs1_data   (rs1_data_tmp),
-    .rs2_data   (rs2_data_tmp)
+    .rs2_data   (rs2_data_tmp),
+    .debug_index(debug_index),
+    .debug_data (debug_data)
   );
 
   assign uop_out = uop_in;
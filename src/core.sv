@@ -26,6 +26,16 @@ module core (
   output logic [`COMMIT_WIDTH-1:0] store_retire,
   output logic                     recover,
 
+  // ======= performance counters ============
+  output logic [`COMMIT_WIDTH-1:0] inst_retire,
+
+  // ======= co-simulation ===================
+  // the retired instructions, slot 0 is the oldest; retire_rd is 0 when
+  // the instruction writes no register
+  output logic [`COMMIT_WIDTH-1:0] [31:0]                     retire_pc,
+  output logic [`COMMIT_WIDTH-1:0] [`ARF_INT_INDEX_SIZE-1:0]  retire_rd,
+  output logic [`COMMIT_WIDTH-1:0] [31:0]                     retire_rd_data,
+
   // ======= debug log related ===============
   input                log_verbose
 );
@@ -39,6 +49,7 @@ module core (
   micro_op_t                      cm_uop_recover;
   micro_op_t  [`COMMIT_WIDTH-1:0] cm_uop_retire;
   logic       [`COMMIT_WIDTH-1:0] cm_store_retire;
+  logic       [`COMMIT_WIDTH-1:0] cm_inst_retire;
 
   micro_op_t                      uop_recover;
   micro_op_t  [`COMMIT_WIDTH-1:0] uop_retire;
@@ -46,6 +57,7 @@ module core (
   always_comb begin
     for (int i = 0; i < `COMMIT_WIDTH; i++) begin
       cm_store_retire[i] = (cm_uop_retire[i].mem_type == MEM_ST);
+      cm_inst_retire[i]  = cm_uop_retire[i].valid;
     end
   end
 
@@ -55,16 +67,28 @@ module core (
       uop_recover <= 0;
       uop_retire  <= 0;
       store_retire <= 0;
+      inst_retire  <= 0;
     end else begin
       recover     <= cm_recover;
       uop_recover <= cm_uop_recover;
       uop_retire  <= cm_uop_retire;
       store_retire <= cm_store_retire;
+      inst_retire  <= cm_inst_retire;
     end
   end
 
   assign clear = cm_recover;
 
+  logic [`COMMIT_WIDTH-1:0] [`PRF_INT_INDEX_SIZE-1:0] retire_rd_prf;
+
+  always_comb begin
+    for (int i = 0; i < `COMMIT_WIDTH; i++) begin
+      retire_pc[i]     = uop_retire[i].pc;
+      retire_rd[i]     = uop_retire[i].rd_valid ? uop_retire[i].rd_arf_int_index : 0;
+      retire_rd_prf[i] = uop_retire[i].rd_prf_int_index;
+    end
+  end
+
   /* Stage Stall Signal */
   logic                         if_stall;
   logic                         fb_full = 0;
@@ -431,7 +455,9 @@ module core (
     .rd_en    (rf_int_rd_en_in      ),
     .uop_out  (rf_int_uop_out       ),
     .rs1_data (rf_int_rs1_data_out  ),
-    .rs2_data (rf_int_rs2_data_out  )
+    .rs2_data (rf_int_rs2_data_out  ),
+    .debug_index (retire_rd_prf     ),
+    .debug_data  (retire_rd_data    )
   );
 
   /* RF ~ EX Pipeline Registers */
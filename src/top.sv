@@ -26,6 +26,14 @@ module top (
   output logic [`COMMIT_WIDTH-1:0] store_retire,
   output logic                     recover,
 
+  // ======= performance counters ============
+  output logic [`COMMIT_WIDTH-1:0] inst_retire,
+
+  // ======= co-simulation ===================
+  output logic [`COMMIT_WIDTH-1:0] [31:0]                     retire_pc,
+  output logic [`COMMIT_WIDTH-1:0] [`ARF_INT_INDEX_SIZE-1:0]  retire_rd,
+  output logic [`COMMIT_WIDTH-1:0] [31:0]                     retire_rd_data,
+
   // ======= debug log related ===============
   input                log_verbose
 );
@@ -44,6 +52,10 @@ module top (
     .core2dcache_addr       (core2dcache_addr       ),
     .store_retire           (store_retire           ),
     .recover                (recover                ),
+    .inst_retire            (inst_retire            ),
+    .retire_pc              (retire_pc              ),
+    .retire_rd              (retire_rd              ),
+    .retire_rd_data         (retire_rd_data         ),
     .log_verbose            (log_verbose            )
   );
 